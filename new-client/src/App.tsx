@@ -1,4 +1,4 @@
-import { useState, useEffect } from 'react';
+import { useState, useEffect, useRef } from 'react';
 import './App.css';
 import 'bootstrap/dist/css/bootstrap.min.css';
 import React from 'react';
@@ -28,6 +28,38 @@ interface Order {
   items: CartItem[];
 }
 
+// Parses one "id,name,type,bid,price,inventory,bidder,end" catalog entry,
+// stamped with the catalog version it was sent at
+const parseItem = (entry: string, version: number): Item => {
+  const [id, name, listingType, currentBid, fixedPrice, inventory, bidderId, endTime] = entry.split(',');
+  return {
+    id,
+    name,
+    description: '', // Description not included in list view
+    listingType: listingType as 'auction' | 'fixed',
+    currentBid: parseFloat(currentBid),
+    fixedPrice: parseFloat(fixedPrice),
+    inventory: parseInt(inventory),
+    bidderId: bidderId ? parseInt(bidderId) : undefined,
+    endTime: parseInt(endTime),
+    version
+  };
+};
+
+// Replaces existing items by id and appends new ones. An update older than
+// what we already have (e.g. an ITEM_UPDATE delayed behind a delta) is dropped.
+const mergeItems = (prev: Item[], changed: Item[]): Item[] => {
+  const byId = new Map(changed.map(item => [item.id, item]));
+  const merged = prev.map(item => {
+    const update = byId.get(item.id);
+    if (!update) return item;
+    byId.delete(item.id);
+    if (update.version < item.version) return item;
+    return { ...item, ...update, description: item.description };
+  });
+  return [...merged, ...byId.values()];
+};
+
 class ErrorBoundary extends React.Component<{ children: React.ReactNode }> {
   state = { hasError: false };
 
@@ -52,6 +84,9 @@ function App() {
   const [items, setItems] = useState<Item[]>([]);
   const [cart, setCart] = useState<CartItem[]>([]);
   const [orders, setOrders] = useState<Order[]>([]);
+  // Cursor for the page after the oldest order loaded so far; 0 when there are no older orders
+  const [olderOrdersCursor, setOlderOrdersCursor] = useState(0);
+  const oldestOrderId = useRef(0);
   const [form, setForm] = useState({
     username: '',
     password: '',
@@ -71,6 +106,8 @@ function App() {
   } | null>(null);
   const [isConnecting, setIsConnecting] = useState(true);
   const [activeTab, setActiveTab] = useState<'auctions' | 'shop' | 'cart' | 'orders'>('auctions');
+  // Catalog version our items reflect; the server sends only what changed since
+  const catalogVersion = useRef(0);
 
   const handleMessage = (event: MessageEvent) => {
     const [type, ...rest] = event.data.split('|');
@@ -80,47 +117,33 @@ function App() {
       setForm(prev => ({ ...prev, sessionToken: rest[0] }));
       setIsAdmin(rest[1] === '1');
       showNotification('Login successful!', 'success');
+      setOrders([]);
+      setOlderOrdersCursor(0);
+      oldestOrderId.current = 0;
       if (socket) {
-        socket.send('GET_ITEMS');
+        socket.send(`GET_ITEMS_SINCE|${catalogVersion.current}`);
         socket.send(`GET_CART|${rest[0]}`);
         socket.send(`GET_ORDERS|${rest[0]}`);
       }
     } else if (type === 'GET_ITEMS') {
       // Server is requesting items, send them
       if (socket) {
-        socket.send('GET_ITEMS');
+        socket.send(`GET_ITEMS_SINCE|${catalogVersion.current}`);
       }
     } else if (type === 'ITEMS_LIST') {
-      const newItems = rest.map((item: string) => {
-        const [id, name, listingType, currentBid, fixedPrice, inventory, bidderId, endTime] = item.split(',');
-        return {
-          id,
-          name,
-          description: '', // Description not included in list view
-          listingType: listingType as 'auction' | 'fixed',
-          currentBid: parseFloat(currentBid),
-          fixedPrice: parseFloat(fixedPrice),
-          inventory: parseInt(inventory),
-          bidderId: bidderId ? parseInt(bidderId) : undefined,
-          endTime: parseInt(endTime),
-          version: 1
-        };
-      });
-      setItems(newItems);
+      setItems(rest.map((entry: string) => parseItem(entry, 0)));
+    } else if (type === 'ITEMS_SNAPSHOT') {
+      const [version, ...entries] = rest;
+      catalogVersion.current = parseInt(version);
+      setItems(entries.map((entry: string) => parseItem(entry, parseInt(version))));
+    } else if (type === 'ITEMS_DELTA') {
+      const [version, ...entries] = rest;
+      catalogVersion.current = parseInt(version);
+      const changed = entries.map((entry: string) => parseItem(entry, parseInt(version)));
+      setItems(prev => mergeItems(prev, changed));
     } else if (type === 'ITEM_UPDATE') {
-      const [id, name, listingType, currentBid, fixedPrice, inventory, bidderId, endTime] = rest[0].split(',');
-      setItems(prev => prev.map(item =>
-        item.id === id ? {
-          ...item,
-          name,
-          listingType: listingType as 'auction' | 'fixed',
-          currentBid: parseFloat(currentBid),
-          fixedPrice: parseFloat(fixedPrice),
-          inventory: parseInt(inventory),
-          bidderId: bidderId ? parseInt(bidderId) : undefined,
-          endTime: parseInt(endTime)
-        } : item
-      ));
+      const [version, entry] = rest;
+      setItems(prev => mergeItems(prev, [parseItem(entry, parseInt(version))]));
     } else if (type === 'CART_ITEMS') {
       console.log('Processing cart items:', rest);
       const cartItems: CartItem[] = [];
@@ -184,14 +207,16 @@ function App() {
     } else if (type === 'ADMIN_SUCCESS') {
       showNotification(rest.join('|'), 'success');
       if (socket) {
-        socket.send('GET_ITEMS');
+        socket.send(`GET_ITEMS_SINCE|${catalogVersion.current}`);
       }
     } else if (type === 'ERROR') {
       const errorMessage = rest.join('|');
       showNotification(errorMessage, 'error');
       console.error('Server error:', errorMessage);
     } else if (type === 'ORDERS_LIST') {
-      const newOrders: Order[] = rest.map((order: string) => {
+      // Pages come newest first; a trailing NEXT,<cursor> entry means older orders can be paged in
+      const next = rest.find((entry: string) => entry.startsWith('NEXT,'));
+      const newOrders: Order[] = rest.filter((entry: string) => !entry.startsWith('NEXT,')).map((order: string) => {
         const [id, totalAmount, status, itemsStr] = order.split(',');
         const orderItems: CartItem[] = itemsStr.split(';').map(itemStr => {
           const [itemId, quantity, price] = itemStr.split(':');
@@ -213,7 +238,17 @@ function App() {
           items: orderItems
         };
       });
-      setOrders(newOrders);
+      // Merge by id, so a refreshed first page keeps the older pages already loaded
+      setOrders(prev => {
+        const byId = new Map(prev.map(order => [order.id, order]));
+        newOrders.forEach(order => byId.set(order.id, order));
+        return [...byId.values()].sort((a, b) => b.id - a.id);
+      });
+      const pageOldest = newOrders.length > 0 ? newOrders[newOrders.length - 1].id : 0;
+      if (pageOldest > 0 && (oldestOrderId.current === 0 || pageOldest <= oldestOrderId.current)) {
+        oldestOrderId.current = pageOldest;
+        setOlderOrdersCursor(next ? parseInt(next.split(',')[1]) : 0);
+      }
       console.log("ORDERS_LIST fired:", rest);
       console.log("Parsed orders:", newOrders);
     } else if (type === 'ACK') {
@@ -238,8 +273,9 @@ function App() {
           console.log('Connected to WebSocket server');
           setSocket(ws);
           setIsConnecting(false);
+          // Catch up on whatever changed while we were disconnected
+          ws.send(`GET_ITEMS_SINCE|${catalogVersion.current}`);
           if (form.sessionToken) {
-            ws.send('GET_ITEMS');
             ws.send(`GET_CART|${form.sessionToken}`);
           }
         };
@@ -250,12 +286,14 @@ function App() {
           handleMessage(event);
         };
 
+        // We only close the socket ourselves on unmount, so any other close
+        // (including the server dropping us with 1008 for falling behind on
+        // broadcasts, which is a clean close) reconnects and onopen resyncs
         ws.onclose = (event) => {
           if (!isMounted) return;
-          if (!event.wasClean) {
-            showNotification('Connection lost. Reconnecting...', 'error');
-            reconnectTimeout = setTimeout(connect, 3000);
-          }
+          showNotification(event.code === 1008 ? 'Fell behind on updates. Reconnecting...'
+                                               : 'Connection lost. Reconnecting...', 'error');
+          reconnectTimeout = setTimeout(connect, event.code === 1008 ? 0 : 3000);
         };
 
         ws.onerror = (error) => {
@@ -764,6 +802,14 @@ function App() {
             </table>
           </div>
         )}
+        {olderOrdersCursor > 0 && (
+          <button
+            className="btn btn-outline-secondary btn-sm"
+            onClick={() => socket?.send(`GET_ORDERS|${form.sessionToken}|${olderOrdersCursor}|20`)}
+          >
+            Load older orders
+          </button>
+        )}
       </div>
     </div>
   );
@@ -0,0 +1,375 @@
+#include "bidding.h"
+#include "wire.h"
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Microbenchmarks for the server's hot paths, linked against the same
+// library as the server. Everything runs in-process against a shared-cache
+// in-memory SQLite database. The "sockets" are ix::WebSockets that are never
+// connected, so sends are dropped and only the server's own work is measured.
+
+// --------------------------
+// Fixture
+// --------------------------
+vector<string> split(const string &text, char delimiter)
+{
+    vector<string> fields;
+    size_t start = 0, end;
+    while ((end = text.find(delimiter, start)) != string::npos)
+    {
+        fields.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    fields.push_back(text.substr(start));
+    return fields;
+}
+
+struct MockClient
+{
+    shared_ptr<ix::WebSocket> ws = make_shared<ix::WebSocket>();
+    shared_ptr<Connection> conn = make_shared<Connection>();
+
+    MockClient() { conn->ws = ws; }
+};
+
+struct Server
+{
+    MockClient admin;
+    MockClient user;
+    string admin_token;
+    string user_token;
+    int user_id = -1;
+    int auction_id = -1;
+    Item stock_item;  // Fixed price, effectively unlimited inventory
+    double next_bid = 1e6;
+
+    Server()
+    {
+        // Commit every checkout on arrival instead of waiting out a batch window
+        setenv("CHECKOUT_BATCH", "1", 0);
+        setenv("METRICS_DUMP_S", "3600", 0);
+        setenv("LOG_LEVEL", "error", 0);
+
+        init_database("file:ivory_bench?mode=memory&cache=shared");
+        seed_test_data();
+        load_items_from_db();
+        start_services();
+
+        admin_token = start_session(authenticate_user("admin", "admin"), admin.conn);
+        user_id = authenticate_user("user1", "pass1");
+        user_token = start_session(user_id, user.conn);
+
+        handle_message("ADMIN|" + admin_token + "|ADD_ITEM|Bench Stock|fixed|9.99|1000000000", admin.ws, admin.conn);
+        find_items();
+    }
+
+    // Picks the benchmark's items out of ITEMS_LIST
+    void find_items()
+    {
+        auto entries = split(*items_list(false), '|');
+        for (size_t i = 1; i < entries.size(); i++)
+        {
+            auto fields = split(entries[i], ',');
+            if (fields.size() != 8)
+                continue;
+
+            if (fields[2] == "auction" && auction_id < 0)
+            {
+                auction_id = stoi(fields[0]);
+            }
+            else if (fields[1] == "Bench Stock")
+            {
+                stock_item.id = stoi(fields[0]);
+                stock_item.name = fields[1];
+                stock_item.listing_type = "fixed";
+                stock_item.fixed_price = stod(fields[4]);
+                stock_item.inventory = stoi(fields[5]);
+            }
+        }
+    }
+};
+
+Server &server()
+{
+    static Server instance;
+    return instance;
+}
+
+// --------------------------
+// Parsing & Dispatch
+// --------------------------
+static void BM_Tokenize(benchmark::State &state)
+{
+    string frame = "BID|3|1250.50|2f1e6c1a-93b4-4c3e-9d53-7a1e8b0c5d42";
+    Tokens parts;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tokenize(frame, '|', parts));
+        benchmark::DoNotOptimize(parts);
+    }
+}
+BENCHMARK(BM_Tokenize);
+
+// PROTOCOL does almost nothing, so this is tokenize + verb lookup + one send
+static void BM_HandleMessageDispatch(benchmark::State &state)
+{
+    Server &s = server();
+    string frame = "PROTOCOL|text";
+    for (auto _ : state)
+        handle_message(frame, s.user.ws, s.user.conn);
+}
+BENCHMARK(BM_HandleMessageDispatch);
+
+static void BM_GenerateUuid(benchmark::State &state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(generate_uuid());
+}
+BENCHMARK(BM_GenerateUuid);
+
+// --------------------------
+// Serialization
+// --------------------------
+
+// Arg 0: text, 1: binary. Served from the catalog's cached frame.
+static void BM_ItemsList(benchmark::State &state)
+{
+    server();
+    bool binary = state.range(0);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(items_list(binary));
+}
+BENCHMARK(BM_ItemsList)->Arg(0)->Arg(1);
+
+// Args: cart lines, binary
+static void BM_CartItems(benchmark::State &state)
+{
+    Cart cart;
+    for (int i = 0; i < state.range(0); i++)
+    {
+        cart.lines.push_back({i + 1, 2, 19.99, "Item name " + to_string(i)});
+        cart.total += 2 * 19.99;
+    }
+    bool binary = state.range(1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(cart_message(cart, binary));
+}
+BENCHMARK(BM_CartItems)->ArgsProduct({{1, 10, 50}, {0, 1}});
+
+// --------------------------
+// Wire Format Round Trips
+// --------------------------
+// Each decodes a binary frame with wire.h and, before timing anything,
+// checks it against what the server encoded: the text form of the same frame
+// for items, the source Cart for carts. A mismatch fails the benchmark, so
+// the encoders and the decoder can't drift apart unnoticed.
+
+// Text entries print doubles with six decimals
+bool same_item(const WireItem &item, const string &entry)
+{
+    auto fields = split(entry, ',');
+    auto close = [](double a, const string &b) { return fabs(a - stod(b)) <= 1e-6; };
+    return fields.size() == 8 && item.id == stoi(fields[0]) && item.name == fields[1] &&
+           item.auction == (fields[2] == "auction") && close(item.current_bid, fields[3]) &&
+           close(item.fixed_price, fields[4]) && item.inventory == stoi(fields[5]) &&
+           item.bidder_id == stoi(fields[6]) && item.end_time == stoll(fields[7]);
+}
+
+static void BM_DecodeItemsList(benchmark::State &state)
+{
+    server();
+    Frame binary = items_list(true);
+    auto entries = split(*items_list(false), '|');
+    map<int, string> by_id;
+    for (size_t i = 1; i < entries.size(); i++)
+        by_id[stoi(entries[i])] = entries[i];
+
+    WireFrame frame;
+    bool ok = decode_frame(*binary, frame) && frame.type == WireType::ItemsList &&
+              frame.items.size() == by_id.size();
+    for (size_t i = 0; ok && i < frame.items.size(); i++)
+        ok = by_id.count(frame.items[i].id) && same_item(frame.items[i], by_id[frame.items[i].id]);
+    if (!ok)
+    {
+        state.SkipWithError("binary ITEMS_LIST does not match the text one");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        decode_frame(*binary, frame);
+        benchmark::DoNotOptimize(frame);
+    }
+}
+BENCHMARK(BM_DecodeItemsList);
+
+static void BM_DecodeCartItems(benchmark::State &state)
+{
+    Cart cart;
+    for (int i = 0; i < state.range(0); i++)
+    {
+        cart.lines.push_back({i + 1, i + 2, 19.99 + i, "Item name " + to_string(i)});
+        cart.total += (i + 2) * (19.99 + i);
+    }
+    string binary = cart_message(cart, true);
+
+    WireFrame frame;
+    bool ok = decode_frame(binary, frame) && frame.type == WireType::CartItems &&
+              frame.cart.size() == cart.lines.size() && frame.cart_total == cart.total;
+    for (size_t i = 0; ok && i < frame.cart.size(); i++)
+    {
+        const CartItem &line = cart.lines[i];
+        ok = frame.cart[i].item_id == line.item_id && frame.cart[i].quantity == line.quantity &&
+             frame.cart[i].price == line.price && frame.cart[i].name == line.name;
+    }
+    if (!ok)
+    {
+        state.SkipWithError("binary CART_ITEMS does not decode to its cart");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        decode_frame(binary, frame);
+        benchmark::DoNotOptimize(frame);
+    }
+}
+BENCHMARK(BM_DecodeCartItems)->Arg(1)->Arg(50);
+
+static void BM_DecodeItemUpdate(benchmark::State &state)
+{
+    Server &s = server();
+    Frame binary = item_update_frame(s.auction_id, true);
+    Frame text = item_update_frame(s.auction_id, false);
+
+    // ITEM_UPDATE|<version>|<entry>
+    WireFrame frame;
+    auto fields = split(text ? *text : "", '|');
+    bool ok = binary && fields.size() == 3 && decode_frame(*binary, frame) &&
+              frame.type == WireType::ItemUpdate && to_string(frame.version) == fields[1] &&
+              same_item(frame.items[0], fields[2]);
+    if (!ok)
+    {
+        state.SkipWithError("binary ITEM_UPDATE does not match the text one");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        decode_frame(*binary, frame);
+        benchmark::DoNotOptimize(frame);
+    }
+}
+BENCHMARK(BM_DecodeItemUpdate);
+
+// --------------------------
+// Carts & Orders
+// --------------------------
+static void BM_AddToCart(benchmark::State &state)
+{
+    Server &s = server();
+    string frame = "ADD_TO_CART|" + to_string(s.stock_item.id) + "|1|" + s.user_token;
+    for (auto _ : state)
+        handle_message(frame, s.user.ws, s.user.conn);
+}
+BENCHMARK(BM_AddToCart);
+
+// One order through the checkout pipeline and its SQLite commit
+static void BM_CreateOrder(benchmark::State &state)
+{
+    Server &s = server();
+    vector<pair<Item, int>> order{{s.stock_item, 1}};
+    for (auto _ : state)
+    {
+        if (create_order(s.user_id, order, false) <= 0)
+        {
+            state.SkipWithError("create_order failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_CreateOrder)->UseRealTime();
+
+// --------------------------
+// Bids
+// --------------------------
+// Run after the order benchmarks: the bid journal is still writing these
+// bids back for a while and would hold up every checkout commit.
+
+// Arg: bids settled together in one burst on the same item
+static void BM_ProcessBids(benchmark::State &state)
+{
+    Server &s = server();
+    vector<PendingBid> bids(state.range(0));
+    for (auto _ : state)
+    {
+        for (auto &bid : bids)
+            bid = {s.user_id, s.next_bid++, {}, chrono::steady_clock::now()};
+        process_bids(s.auction_id, bids);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ProcessBids)->Arg(1)->Arg(16)->Arg(256);
+
+// A bid changes the catalog, so the next ITEMS_LIST is rebuilt from scratch
+static void BM_ItemsListAfterBid(benchmark::State &state)
+{
+    Server &s = server();
+    bool binary = state.range(0);
+    for (auto _ : state)
+    {
+        vector<PendingBid> bids{{s.user_id, s.next_bid++, {}, chrono::steady_clock::now()}};
+        process_bids(s.auction_id, bids);
+        benchmark::DoNotOptimize(items_list(binary));
+    }
+}
+BENCHMARK(BM_ItemsListAfterBid)->Arg(0)->Arg(1);
+
+// --------------------------
+// Broadcast
+// --------------------------
+
+// Arg: connected clients. Measures one broadcast until every sender shard
+// has handed it to all of its clients.
+static void BM_Broadcast(benchmark::State &state)
+{
+    server();
+    vector<MockClient> clients(state.range(0));
+    for (auto &client : clients)
+        connect_client(client.ws.get(), client.conn);
+
+    string message = "AUCTION_ENDED|1,Antique Chair,1250.000000,2,42";
+    for (auto _ : state)
+    {
+        broadcast(message);
+        wait_for_broadcasts();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+
+    for (auto &client : clients)
+        disconnect_client(client.ws.get());
+}
+BENCHMARK(BM_Broadcast)->Arg(10)->Arg(100)->Arg(1000)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    // The server's workers are detached and never stop, so its globals can't
+    // be torn down under them
+    fflush(stdout);
+    _Exit(0);
+}
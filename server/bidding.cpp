@@ -0,0 +1,4505 @@
+#include "bidding.h"
+#include "histogram.h"
+#include "wire.h"
+
+#include <ixwebsocket/IXWebSocket.h>
+#include <sqlite3.h>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <ctime>
+#include <random>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <optional>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <tuple>
+#include <utility>
+
+using namespace std;
+
+// --------------------------
+// Logging
+// --------------------------
+
+// Log calls format into a fixed-size record on the calling thread's own ring
+// and return; a single writer thread drains every ring, orders the records by
+// time and writes them to stderr in one go. Nothing on the logging path takes
+// a lock or makes a syscall, so it is safe to log while holding db_mutex. A
+// full ring drops the record and counts it rather than blocking.
+enum class LogLevel : uint8_t
+{
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+class Logger
+{
+    struct Record
+    {
+        int64_t time_us;
+        LogLevel level;
+        uint16_t length;
+        char text[236];
+    };
+
+    // Single producer (the owning thread), single consumer (the writer)
+    struct Ring
+    {
+        static constexpr size_t capacity = 1024;  // Power of two
+        array<Record, capacity> records;
+        atomic<size_t> head{0};  // Next slot to write, producer only
+        atomic<size_t> tail{0};  // Next slot to read, consumer only
+        atomic<uint64_t> dropped{0};
+        atomic<bool> retired{false};  // Owning thread has exited
+    };
+
+    // Retires the thread's ring when the thread exits; the writer frees it once drained
+    struct RingHandle
+    {
+        Ring *ring = nullptr;
+        ~RingHandle()
+        {
+            if (ring)
+                ring->retired.store(true, memory_order_release);
+        }
+    };
+
+    atomic<LogLevel> threshold{LogLevel::Info};
+    mutex rings_mtx;  // Guards rings; taken once per thread and by the writer
+    vector<unique_ptr<Ring>> rings;
+    mutex drain_mtx;  // Serializes consumers (writer thread and flush)
+    chrono::milliseconds interval{10};
+
+    Ring &local_ring()
+    {
+        thread_local RingHandle handle;
+        if (!handle.ring)
+        {
+            auto ring = make_unique<Ring>();
+            handle.ring = ring.get();
+            lock_guard<mutex> lock(rings_mtx);
+            rings.push_back(move(ring));
+        }
+        return *handle.ring;
+    }
+
+    static void append(Record &r, string_view text)
+    {
+        size_t n = min(text.size(), sizeof(r.text) - r.length);
+        memcpy(r.text + r.length, text.data(), n);
+        r.length += static_cast<uint16_t>(n);
+    }
+
+    static void append(Record &r, const char *text) { append(r, string_view(text ? text : "(null)")); }
+    static void append(Record &r, const string &text) { append(r, string_view(text)); }
+    static void append(Record &r, char c) { append(r, string_view(&c, 1)); }
+
+    template <typename T>
+    static enable_if_t<is_arithmetic_v<T>> append(Record &r, T value)
+    {
+        char buf[32];
+        if constexpr (is_floating_point_v<T>)
+        {
+            int n = snprintf(buf, sizeof(buf), "%.2f", static_cast<double>(value));
+            append(r, string_view(buf, min<size_t>(max(n, 0), sizeof(buf) - 1)));
+        }
+        else
+        {
+            auto result = to_chars(buf, buf + sizeof(buf), value);
+            append(r, string_view(buf, result.ptr - buf));
+        }
+    }
+
+    static const char *level_name(LogLevel level)
+    {
+        switch (level)
+        {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        default: return "ERROR";
+        }
+    }
+
+    // Moves everything buffered to stderr; returns the number of records written
+    size_t drain()
+    {
+        lock_guard<mutex> drain_lock(drain_mtx);
+        vector<Record> batch;
+        uint64_t dropped = 0;
+        {
+            lock_guard<mutex> lock(rings_mtx);
+            for (auto it = rings.begin(); it != rings.end();)
+            {
+                Ring &ring = **it;
+                bool retired = ring.retired.load(memory_order_acquire);
+                size_t tail = ring.tail.load(memory_order_relaxed);
+                size_t head = ring.head.load(memory_order_acquire);
+                for (; tail != head; tail++)
+                    batch.push_back(ring.records[tail & (Ring::capacity - 1)]);
+                ring.tail.store(tail, memory_order_release);
+                dropped += ring.dropped.exchange(0, memory_order_relaxed);
+
+                // Nothing can be appended after retirement, so it is empty for good
+                if (retired)
+                    it = rings.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        stable_sort(batch.begin(), batch.end(),
+                    [](const Record &a, const Record &b) { return a.time_us < b.time_us; });
+
+        string out;
+        out.reserve(batch.size() * 96);
+        for (const Record &r : batch)
+        {
+            time_t seconds = static_cast<time_t>(r.time_us / 1000000);
+            tm utc;
+            gmtime_r(&seconds, &utc);
+            char stamp[96];
+            snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d.%06lldZ %-5s ",
+                     utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                     static_cast<long long>(r.time_us % 1000000), level_name(r.level));
+            out += stamp;
+            out.append(r.text, r.length);
+            out += '\n';
+        }
+        if (dropped)
+            out += "WARN  logger dropped " + to_string(dropped) + " records (ring full)\n";
+
+        if (!out.empty())
+        {
+            fwrite(out.data(), 1, out.size(), stderr);
+            fflush(stderr);
+        }
+        return batch.size();
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            if (drain() == 0)
+                this_thread::sleep_for(interval);
+        }
+    }
+
+public:
+    // LOG_LEVEL=debug|info|warn|error, default info
+    void start(chrono::milliseconds flush_interval)
+    {
+        interval = flush_interval;
+        if (const char *name = getenv("LOG_LEVEL"))
+        {
+            string_view level(name);
+            if (level == "debug")
+                threshold = LogLevel::Debug;
+            else if (level == "warn")
+                threshold = LogLevel::Warn;
+            else if (level == "error")
+                threshold = LogLevel::Error;
+        }
+        thread(&Logger::run, this).detach();
+    }
+
+    bool enabled(LogLevel level) const { return level >= threshold.load(memory_order_relaxed); }
+
+    template <typename... Args>
+    void write(LogLevel level, const Args &...args)
+    {
+        Ring &ring = local_ring();
+        size_t head = ring.head.load(memory_order_relaxed);
+        if (head - ring.tail.load(memory_order_acquire) >= Ring::capacity)
+        {
+            ring.dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        Record &r = ring.records[head & (Ring::capacity - 1)];
+        r.time_us = chrono::duration_cast<chrono::microseconds>(
+                        chrono::system_clock::now().time_since_epoch()).count();
+        r.level = level;
+        r.length = 0;
+        (append(r, args), ...);
+        ring.head.store(head + 1, memory_order_release);
+    }
+
+    // Writes out whatever is buffered; for use before the process exits
+    void flush() { drain(); }
+};
+
+Logger logger;
+
+// Caps a call site at `per_second` records; the first record after a quiet
+// spell reports how many were suppressed.
+class LogLimit
+{
+    const uint32_t per_second;
+    atomic<int64_t> window{0};
+    atomic<uint32_t> count{0};
+    atomic<uint32_t> suppressed{0};
+
+public:
+    explicit LogLimit(uint32_t per_second) : per_second(per_second) {}
+
+    // Returns false to drop; otherwise sets `skipped` to the count dropped since the last record
+    bool allow(uint32_t &skipped)
+    {
+        int64_t now = chrono::duration_cast<chrono::seconds>(
+                          chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t current = window.load(memory_order_relaxed);
+        if (current != now && window.compare_exchange_strong(current, now, memory_order_relaxed))
+            count.store(0, memory_order_relaxed);
+
+        if (count.fetch_add(1, memory_order_relaxed) >= per_second)
+        {
+            suppressed.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        skipped = suppressed.exchange(0, memory_order_relaxed);
+        return true;
+    }
+};
+
+// Arguments are only evaluated when the level is enabled
+#define LOG(level, ...)                                          \
+    do                                                           \
+    {                                                            \
+        if (logger.enabled(LogLevel::level))                     \
+            logger.write(LogLevel::level, __VA_ARGS__);          \
+    } while (0)
+
+// For sites that can fire on every request when something is wrong
+#define LOG_LIMITED(level, per_second, ...)                                      \
+    do                                                                           \
+    {                                                                            \
+        static LogLimit log_limit_(per_second);                                  \
+        uint32_t log_skipped_ = 0;                                               \
+        if (logger.enabled(LogLevel::level) && log_limit_.allow(log_skipped_))   \
+        {                                                                        \
+            if (log_skipped_)                                                    \
+                logger.write(LogLevel::level, __VA_ARGS__, " (", log_skipped_,   \
+                             " similar suppressed)");                           \
+            else                                                                 \
+                logger.write(LogLevel::level, __VA_ARGS__);                      \
+        }                                                                        \
+    } while (0)
+
+// --------------------------
+// Metrics
+// --------------------------
+// Latency and size distributions, each a named Prometheus summary over the
+// shared log-linear buckets in histogram.h.
+class Histogram : public LogHistogram
+{
+public:
+    enum class Unit
+    {
+        Nanoseconds,  // Exposed to Prometheus in seconds
+        Count,
+    };
+
+    const string name;
+    const string labels;  // Prometheus label set without braces, may be empty
+    const string help;
+    const Unit unit;
+
+    Histogram(string name, string labels, string help, Unit unit = Unit::Nanoseconds);
+};
+
+// Records the time from construction to the end of the scope
+class ScopedTimer
+{
+    Histogram &histogram;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+public:
+    explicit ScopedTimer(Histogram &histogram) : histogram(histogram) {}
+    ~ScopedTimer() { histogram.record_since(start); }
+};
+
+// Every histogram registers itself here; gauges are callbacks sampled only
+// when stats are read, so queues pay nothing to be observable.
+class MetricsRegistry
+{
+    struct Gauge
+    {
+        string name;
+        string help;
+        function<double()> sample;
+    };
+
+    mutex mtx;
+    vector<const Histogram *> histograms;
+    vector<Gauge> gauges;
+
+    static string series(const string &name, const string &labels, const string &extra = "")
+    {
+        string out = name;
+        if (!labels.empty() || !extra.empty())
+            out += "{" + labels + (!labels.empty() && !extra.empty() ? "," : "") + extra + "}";
+        return out;
+    }
+
+    static string format(double value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", value);
+        return buf;
+    }
+
+    void dump(const string &path)
+    {
+        string tmp = path + ".tmp";
+        string text = prometheus();
+        FILE *out = fopen(tmp.c_str(), "w");
+        if (!out)
+        {
+            LOG_LIMITED(Warn, 1, "Cannot write metrics to ", tmp);
+            return;
+        }
+        bool ok = fwrite(text.data(), 1, text.size(), out) == text.size();
+        ok = fclose(out) == 0 && ok;
+        // Renamed into place so a scraper never reads a half-written file
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            LOG_LIMITED(Warn, 1, "Cannot write metrics to ", path);
+    }
+
+public:
+    void add(const Histogram *histogram)
+    {
+        lock_guard<mutex> lock(mtx);
+        histograms.push_back(histogram);
+    }
+
+    void gauge(string name, string help, function<double()> sample)
+    {
+        lock_guard<mutex> lock(mtx);
+        gauges.push_back({move(name), move(help), move(sample)});
+    }
+
+    // Prometheus text exposition format
+    string prometheus()
+    {
+        lock_guard<mutex> lock(mtx);
+        string out;
+        // A metric family's series have to be contiguous
+        vector<const Histogram *> ordered = histograms;
+        stable_sort(ordered.begin(), ordered.end(),
+                    [](const Histogram *a, const Histogram *b) { return a->name < b->name; });
+        unordered_set<string> described;
+        for (const Histogram *histogram : ordered)
+        {
+            double scale = histogram->unit == Histogram::Unit::Nanoseconds ? 1e-9 : 1.0;
+            if (described.insert(histogram->name).second)
+            {
+                out += "# HELP " + histogram->name + " " + histogram->help + "\n";
+                out += "# TYPE " + histogram->name + " summary\n";
+            }
+            auto snap = histogram->snapshot();
+            for (const char *q : {"0.5", "0.9", "0.99", "0.999"})
+            {
+                out += series(histogram->name, histogram->labels, string("quantile=\"") + q + "\"") + " " +
+                       format(snap.percentile(atof(q)) * scale) + "\n";
+            }
+            out += series(histogram->name + "_sum", histogram->labels) + " " + format(snap.sum * scale) + "\n";
+            out += series(histogram->name + "_count", histogram->labels) + " " + to_string(snap.count) + "\n";
+        }
+        for (const Gauge &gauge : gauges)
+        {
+            out += "# HELP " + gauge.name + " " + gauge.help + "\n";
+            out += "# TYPE " + gauge.name + " gauge\n";
+            out += gauge.name + " " + format(gauge.sample()) + "\n";
+        }
+        return out;
+    }
+
+    // One '|'-separated entry per series for ADMIN STATS; latencies in microseconds
+    string summary()
+    {
+        lock_guard<mutex> lock(mtx);
+        vector<string> entries;
+        for (const Histogram *histogram : histograms)
+        {
+            auto snap = histogram->snapshot();
+            bool timed = histogram->unit == Histogram::Unit::Nanoseconds;
+            double scale = timed ? 1e-3 : 1.0;
+            string suffix = timed ? "_us=" : "=";
+            entries.push_back(series(histogram->name, histogram->labels) + " count=" + to_string(snap.count) +
+                              " p50" + suffix + format(snap.percentile(0.5) * scale) +
+                              " p99" + suffix + format(snap.percentile(0.99) * scale) +
+                              " p999" + suffix + format(snap.percentile(0.999) * scale) +
+                              " max" + suffix + format(snap.max * scale));
+        }
+        for (const Gauge &gauge : gauges)
+            entries.push_back(gauge.name + " " + format(gauge.sample()));
+
+        string out;
+        for (size_t i = 0; i < entries.size(); i++)
+            out += (i ? "|" : "") + entries[i];
+        return out;
+    }
+
+    // Rewrites path with the Prometheus text every interval, for a textfile collector
+    void start_dump(string path, chrono::seconds interval)
+    {
+        thread([this, path = move(path), interval] {
+            while (true)
+            {
+                this_thread::sleep_for(interval);
+                dump(path);
+            }
+        }).detach();
+    }
+};
+
+MetricsRegistry metrics;
+
+Histogram::Histogram(string name, string labels, string help, Unit unit)
+    : name(move(name)), labels(move(labels)), help(move(help)), unit(unit)
+{
+    metrics.add(this);
+}
+
+Histogram db_transaction_histogram(const char *kind)
+{
+    return Histogram("ivory_db_transaction_seconds", string("kind=\"") + kind + "\"",
+                     "Write transaction duration from BEGIN to COMMIT");
+}
+
+// --------------------------
+// Database Setup & Utilities
+// --------------------------
+
+// Every statement the server runs on a hot path. Each connection prepares the
+// whole set once at startup (see StatementCache) instead of compiling SQL on
+// every call while db_mutex is held.
+enum class Stmt
+{
+    Begin,
+    Commit,
+    Rollback,
+    Savepoint,
+    ReleaseSavepoint,
+    RollbackToSavepoint,
+    AuthenticateUser,
+    LoadItems,
+    UpdateBid,
+    InsertBid,
+    SetCartQuantity,
+    DeleteCartItem,
+    GetCartItems,
+    InsertItem,
+    InsertOrder,
+    InsertOrderItem,
+    DecrementInventory,
+    ClearCart,
+    GetOrderTotal,
+    FindPayment,
+    InsertPayment,
+    RetryPayment,
+    FinishPayment,
+    ReleasePaymentClaim,
+    MarkOrderPaid,
+    GetOrdersPage,
+    CloseAuction,
+    Count
+};
+
+const char *const statement_sql[] = {
+    "BEGIN IMMEDIATE",
+    "COMMIT",
+    "ROLLBACK",
+    "SAVEPOINT order_write",
+    "RELEASE order_write",
+    "ROLLBACK TO order_write",
+    "SELECT id FROM users WHERE username = ? AND password_hash = ?",
+    "SELECT id, name, description, listing_type, current_bid, fixed_price, "
+    "inventory, bidder_id, end_time, version FROM items",
+    "UPDATE items SET current_bid = ?, bidder_id = ?, version = ? WHERE id = ?",
+    "INSERT INTO bids (item_id, user_id, amount) VALUES (?, ?, ?)",
+    "INSERT INTO cart (user_id, item_id, quantity) VALUES (?, ?, ?) "
+    "ON CONFLICT(user_id, item_id) DO UPDATE SET quantity = excluded.quantity",
+    "DELETE FROM cart WHERE user_id = ? AND item_id = ?",
+    "SELECT i.id, i.name, i.description, i.listing_type, i.current_bid, i.fixed_price, "
+    "i.inventory, i.bidder_id, i.end_time, i.version, c.quantity "
+    "FROM cart c JOIN items i ON c.item_id = i.id "
+    "WHERE c.user_id = ? ORDER BY c.id",
+    "INSERT INTO items (name, description, listing_type, current_bid, fixed_price, inventory, end_time) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?)",
+    "INSERT INTO orders (user_id, total_amount) VALUES (?, ?)",
+    "INSERT INTO order_items (order_id, item_id, quantity, price, is_auction) "
+    "VALUES (?, ?, ?, ?, ?)",
+    "UPDATE items SET inventory = inventory - ? WHERE id = ? AND inventory >= ?",
+    "DELETE FROM cart WHERE user_id = ?",
+    "SELECT total_amount, status FROM orders WHERE id = ? AND user_id = ?",
+    "SELECT status, transaction_id, order_id, claimed_at FROM payments WHERE idempotency_key = ?",
+    "INSERT INTO payments (order_id, amount, payment_method, status, idempotency_key, claimed_at) "
+    "VALUES (?, ?, ?, 'pending', ?, ?)",
+    "UPDATE payments SET status = 'pending', payment_method = ?, amount = ?, claimed_at = ? "
+    "WHERE idempotency_key = ? AND (status = 'failed' OR (status = 'pending' AND claimed_at < ?))",
+    "UPDATE payments SET status = ?, transaction_id = ? WHERE idempotency_key = ?",
+    "UPDATE payments SET claimed_at = 0 WHERE idempotency_key = ? AND status = 'pending'",
+    "UPDATE orders SET status = 'paid' WHERE id = ?",
+    "SELECT o.id, o.total_amount, o.status, oi.item_id, oi.quantity, oi.price "
+    "FROM (SELECT id, total_amount, status FROM orders "
+    "      WHERE user_id = ? AND id < ? ORDER BY id DESC LIMIT ?) o "
+    "JOIN order_items oi ON o.id = oi.order_id "
+    "ORDER BY o.id DESC, oi.id",
+    "UPDATE items SET end_time = 0, inventory = 0 WHERE id = ?",
+};
+
+static_assert(sizeof(statement_sql) / sizeof(statement_sql[0]) == static_cast<size_t>(Stmt::Count),
+              "statement_sql must have one entry per Stmt");
+
+// Borrowed handle to a cached statement. Resets the statement and clears its
+// bindings when it goes out of scope so the next user starts clean.
+class StatementHandle
+{
+private:
+    sqlite3_stmt *stmt;
+
+public:
+    explicit StatementHandle(sqlite3_stmt *s) : stmt(s) {}
+    StatementHandle(StatementHandle &&other) noexcept : stmt(exchange(other.stmt, nullptr)) {}
+    StatementHandle(const StatementHandle &) = delete;
+    StatementHandle &operator=(const StatementHandle &) = delete;
+
+    ~StatementHandle()
+    {
+        if (stmt)
+        {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+    }
+
+    operator sqlite3_stmt *() const { return stmt; }
+};
+
+class StatementCache
+{
+private:
+    array<sqlite3_stmt *, static_cast<size_t>(Stmt::Count)> stmts{};
+
+public:
+    StatementCache() = default;
+    StatementCache(const StatementCache &) = delete;
+    StatementCache &operator=(const StatementCache &) = delete;
+    ~StatementCache() { finalize_all(); }
+
+    bool prepare_all(sqlite3 *conn)
+    {
+        for (size_t i = 0; i < stmts.size(); i++)
+        {
+            if (sqlite3_prepare_v3(conn, statement_sql[i], -1, SQLITE_PREPARE_PERSISTENT,
+                                   &stmts[i], nullptr) != SQLITE_OK)
+            {
+                LOG(Error, "Prepare failed for \"", statement_sql[i], "\": ", sqlite3_errmsg(conn));
+                finalize_all();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void finalize_all()
+    {
+        for (auto &stmt : stmts)
+        {
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+    }
+
+    StatementHandle get(Stmt id) { return StatementHandle(stmts[static_cast<size_t>(id)]); }
+};
+
+// A SQLite connection together with its own prepared statements. Statements
+// are bound to the connection that compiled them, so every connection the
+// server opens gets its own cache.
+struct DbConnection
+{
+    sqlite3 *handle = nullptr;
+    StatementCache statements;
+
+    StatementHandle statement(Stmt id) { return statements.get(id); }
+
+    bool exec(Stmt id)
+    {
+        auto stmt = statement(id);
+        return sqlite3_step(stmt) == SQLITE_DONE;
+    }
+};
+
+// Pool of read-only connections. WAL lets these read concurrently with the
+// single writer connection, so read-only requests never touch db_mutex.
+// Each connection is leased to one thread at a time.
+class ReadConnectionPool
+{
+private:
+    mutex mtx;
+    condition_variable cv;
+    vector<unique_ptr<DbConnection>> connections;
+    vector<DbConnection *> idle;
+
+    void release(DbConnection *conn)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            idle.push_back(conn);
+        }
+        cv.notify_one();
+    }
+
+public:
+    class Lease
+    {
+    private:
+        ReadConnectionPool *pool;
+        DbConnection *conn;
+
+    public:
+        Lease(ReadConnectionPool *p, DbConnection *c) : pool(p), conn(c) {}
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease() { pool->release(conn); }
+
+        DbConnection *operator->() const { return conn; }
+    };
+
+    bool open(const char *path, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            auto conn = make_unique<DbConnection>();
+            int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_URI;
+            if (sqlite3_open_v2(path, &conn->handle, flags, nullptr) != SQLITE_OK)
+            {
+                LOG(Error, "Cannot open read connection: ", sqlite3_errmsg(conn->handle));
+                return false;
+            }
+            sqlite3_busy_timeout(conn->handle, 5000);
+            // Only matters for shared-cache (in-memory) databases, where a
+            // reader would otherwise fail with SQLITE_LOCKED mid-write
+            sqlite3_exec(conn->handle, "PRAGMA read_uncommitted=1;", 0, 0, 0);
+            if (!conn->statements.prepare_all(conn->handle))
+            {
+                return false;
+            }
+            idle.push_back(conn.get());
+            connections.push_back(move(conn));
+        }
+        return true;
+    }
+
+    Lease acquire()
+    {
+        unique_lock<mutex> lock(mtx);
+        cv.wait(lock, [this] { return !idle.empty(); });
+        DbConnection *conn = idle.back();
+        idle.pop_back();
+        return Lease(this, conn);
+    }
+};
+
+const char *const database_path = "bidding.db";
+
+DbConnection db;  // Writer connection, serialized by db_mutex
+mutex db_mutex;
+ReadConnectionPool read_pool;
+
+void init_database(const char *path)
+{
+    int rc = sqlite3_open_v2(path, &db.handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
+    if (rc != SQLITE_OK)
+    {
+        LOG(Error, "Cannot open database: ", sqlite3_errmsg(db.handle));
+        logger.flush();
+        exit(1);
+    }
+
+    sqlite3_busy_timeout(db.handle, 5000);
+    sqlite3_exec(db.handle, "PRAGMA journal_mode=WAL;", 0, 0, 0);
+    sqlite3_exec(db.handle, "PRAGMA synchronous=NORMAL;", 0, 0, 0);
+
+    const char *sql =
+        "CREATE TABLE IF NOT EXISTS users ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    username TEXT UNIQUE NOT NULL,"
+        "    password_hash TEXT NOT NULL,"
+        "    is_admin INTEGER DEFAULT 0);"
+        
+        "CREATE TABLE IF NOT EXISTS items ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    name TEXT NOT NULL,"
+        "    description TEXT,"
+        "    listing_type TEXT NOT NULL,"  // 'auction' or 'fixed'
+        "    current_bid REAL DEFAULT 0.0,"
+        "    fixed_price REAL DEFAULT 0.0,"
+        "    inventory INTEGER DEFAULT 1,"
+        "    bidder_id INTEGER,"
+        "    end_time INTEGER,"  // Unix timestamp for auction end
+        "    version INTEGER DEFAULT 1);"
+        
+        "CREATE TABLE IF NOT EXISTS bids ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    item_id INTEGER NOT NULL,"
+        "    user_id INTEGER NOT NULL,"
+        "    amount REAL NOT NULL,"
+        "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);"
+        
+        "CREATE TABLE IF NOT EXISTS orders ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    user_id INTEGER NOT NULL,"
+        "    total_amount REAL NOT NULL,"
+        "    status TEXT DEFAULT 'pending',"  // pending, paid, shipped, completed
+        "    created_at DATETIME DEFAULT CURRENT_TIMESTAMP);"
+        
+        "CREATE TABLE IF NOT EXISTS order_items ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    order_id INTEGER NOT NULL,"
+        "    item_id INTEGER NOT NULL,"
+        "    quantity INTEGER NOT NULL,"
+        "    price REAL NOT NULL,"
+        "    is_auction BOOLEAN NOT NULL);"
+
+        "CREATE INDEX IF NOT EXISTS idx_orders_user ON orders(user_id, id);"
+        "CREATE INDEX IF NOT EXISTS idx_order_items_order ON order_items(order_id);"
+        
+        "CREATE TABLE IF NOT EXISTS cart ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    user_id INTEGER NOT NULL,"
+        "    item_id INTEGER NOT NULL,"
+        "    quantity INTEGER NOT NULL,"
+        "    added_at DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        "    UNIQUE(user_id, item_id));"
+        
+        "CREATE TABLE IF NOT EXISTS payments ("
+        "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "    order_id INTEGER NOT NULL,"
+        "    amount REAL NOT NULL,"
+        "    payment_method TEXT NOT NULL,"
+        "    status TEXT DEFAULT 'pending',"
+        "    transaction_id TEXT,"
+        "    idempotency_key TEXT,"
+        "    claimed_at INTEGER,"  // Unix time a worker last took the payment to the gateway
+        "    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);";
+
+    char *errMsg = 0;
+    rc = sqlite3_exec(db.handle, sql, 0, 0, &errMsg);
+    if (rc != SQLITE_OK)
+    {
+        LOG(Error, "SQL error: ", errMsg);
+        sqlite3_free(errMsg);
+    }
+
+    // Databases from before idempotency keys; a no-op error once the column exists
+    sqlite3_exec(db.handle, "ALTER TABLE payments ADD COLUMN idempotency_key TEXT", 0, 0, 0);
+    sqlite3_exec(db.handle,
+                 "CREATE UNIQUE INDEX IF NOT EXISTS idx_payments_idempotency ON payments(idempotency_key)",
+                 0, 0, 0);
+    sqlite3_exec(db.handle, "ALTER TABLE payments ADD COLUMN claimed_at INTEGER", 0, 0, 0);
+    // At most one payment per order may be in flight or completed
+    if (sqlite3_exec(db.handle,
+                     "CREATE UNIQUE INDEX IF NOT EXISTS idx_payments_order_active ON payments(order_id) "
+                     "WHERE status IN ('pending', 'completed')",
+                     0, 0, 0) != SQLITE_OK)
+    {
+        LOG(Warn, "Cannot enforce one active payment per order: ", sqlite3_errmsg(db.handle));
+    }
+
+    if (!db.statements.prepare_all(db.handle))
+    {
+        exit(1);
+    }
+
+    // One reader per hardware thread; IXWebSocket runs a thread per client,
+    // so leases are bounded here rather than handed out per thread.
+    size_t readers = max(2u, thread::hardware_concurrency());
+    if (!read_pool.open(path, readers))
+    {
+        exit(1);
+    }
+}
+
+// --------------------------
+// Core Data Structures
+// --------------------------
+// Shared with lock-free readers; only last_activity changes after login
+struct UserSession {
+    string token;
+    int user_id;
+    weak_ptr<Connection> conn;
+    atomic<chrono::steady_clock::rep> last_activity{0};
+};
+
+class ItemsMonitor
+{
+private:
+    mutex mtx;
+    condition_variable cv;
+
+public:
+    unique_lock<mutex> get_lock() { return unique_lock<mutex>(mtx); }
+    void wait(unique_lock<mutex> &lock) { cv.wait(lock); }
+    void notify() { cv.notify_one(); }
+};
+
+ItemsMonitor items_monitor;
+unordered_map<int, Item> items;
+
+// --------------------------
+// Utility Functions
+// --------------------------
+string generate_uuid()
+{
+    static random_device rd;
+    static mt19937 gen(rd());
+    uniform_int_distribution<> dis(0, 15);
+    uniform_int_distribution<> dis2(8, 11);
+
+    stringstream ss;
+    ss << hex;
+    for (int i = 0; i < 8; i++)
+        ss << dis(gen);
+    ss << "-";
+    for (int i = 0; i < 4; i++)
+        ss << dis(gen);
+    ss << "-4";
+    for (int i = 0; i < 3; i++)
+        ss << dis(gen);
+    ss << "-";
+    ss << dis2(gen);
+    for (int i = 0; i < 3; i++)
+        ss << dis(gen);
+    ss << "-";
+    for (int i = 0; i < 12; i++)
+        ss << dis(gen);
+    return ss.str();
+}
+
+// Reads a positive integer tuning knob from the environment
+size_t env_size(const char *name, size_t fallback)
+{
+    const char *value = getenv(name);
+    if (!value)
+        return fallback;
+    char *end = nullptr;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    return (end != value && *end == '\0' && parsed > 0) ? parsed : fallback;
+}
+
+// --------------------------
+// Session Registry
+// --------------------------
+// Token lookups run on every message, so they must not contend with each
+// other. Sessions are split across many shards, each a plain map behind its
+// own reader-writer lock: lookups share a shard, and a login or expiry only
+// locks the one shard it edits, for the length of a single insert or erase.
+// last_activity is an atomic on the session itself.
+//
+// Writers also serialize on one mutex, which guards the user_id index and a
+// deadline heap: expiry pops due sessions and re-queues the ones that were
+// active since, so it only ever looks at sessions that might have lapsed.
+class SessionRegistry
+{
+private:
+    using Clock = chrono::steady_clock;
+    using Table = unordered_map<string_view, shared_ptr<UserSession>>;  // Keys view UserSession::token
+    static constexpr size_t shard_count = 64;
+
+    struct alignas(64) Shard
+    {
+        shared_mutex mtx;
+        Table table;
+    };
+
+    struct Deadline
+    {
+        Clock::rep due;
+        shared_ptr<UserSession> session;
+        bool operator>(const Deadline &other) const { return due > other.due; }
+    };
+
+    array<Shard, shard_count> shards;
+    Clock::rep max_idle;
+    Clock::rep touch_granularity = Clock::duration(chrono::seconds(1)).count();
+
+    mutex mtx;  // Writers only
+    unordered_map<int, vector<shared_ptr<UserSession>>> by_user;
+    priority_queue<Deadline, vector<Deadline>, greater<Deadline>> deadlines;
+
+    Shard &shard_for(string_view token)
+    {
+        return shards[hash<string_view>()(token) % shard_count];
+    }
+
+    static Clock::rep now() { return Clock::now().time_since_epoch().count(); }
+
+public:
+    explicit SessionRegistry(Clock::duration idle_limit) : max_idle(idle_limit.count()) {}
+
+    void add(const string &token, int user_id, weak_ptr<Connection> conn)
+    {
+        auto session = make_shared<UserSession>();
+        session->token = token;
+        session->user_id = user_id;
+        session->conn = move(conn);
+        session->last_activity = now();
+
+        lock_guard<mutex> lock(mtx);
+        {
+            Shard &shard = shard_for(session->token);
+            unique_lock<shared_mutex> shard_lock(shard.mtx);
+            shard.table[session->token] = session;
+        }
+        by_user[user_id].push_back(session);
+        deadlines.push({session->last_activity + max_idle, session});
+    }
+
+    // Maps a token to its user_id and records the activity; -1 for unknown
+    // or expired tokens.
+    int resolve(string_view token)
+    {
+        Shard &shard = shard_for(token);
+        shared_lock<shared_mutex> lock(shard.mtx);
+        auto it = shard.table.find(token);
+        if (it == shard.table.end())
+            return -1;
+
+        UserSession &session = *it->second;
+        Clock::rep t = now();
+        // Coarse updates keep a busy session's cache line from bouncing
+        if (t - session.last_activity.load(memory_order_relaxed) > touch_granularity)
+            session.last_activity.store(t, memory_order_relaxed);
+        return session.user_id;
+    }
+
+    bool has_user(int user_id)
+    {
+        lock_guard<mutex> lock(mtx);
+        return by_user.count(user_id) != 0;
+    }
+
+    // Live connections across all of a user's sessions
+    vector<shared_ptr<Connection>> connections(int user_id)
+    {
+        vector<shared_ptr<Connection>> live;
+        lock_guard<mutex> lock(mtx);
+        if (auto user = by_user.find(user_id); user != by_user.end())
+        {
+            for (const auto &session : user->second)
+            {
+                if (auto conn = session->conn.lock())
+                    live.push_back(move(conn));
+            }
+        }
+        return live;
+    }
+
+    // Checks up to max_checks due deadlines, dropping sessions that stayed
+    // idle and re-queueing the rest. Users left with no session at all are
+    // appended to ended. Returns the number checked, so callers can release
+    // the lock between batches.
+    size_t expire_idle(size_t max_checks, vector<int> &ended)
+    {
+        lock_guard<mutex> lock(mtx);
+        Clock::rep t = now();
+        size_t checked = 0;
+        while (checked < max_checks && !deadlines.empty() && deadlines.top().due <= t)
+        {
+            auto session = deadlines.top().session;
+            deadlines.pop();
+            checked++;
+
+            Clock::rep due = session->last_activity.load(memory_order_relaxed) + max_idle;
+            if (due > t)
+            {
+                deadlines.push({due, move(session)});
+                continue;
+            }
+
+            auto &owned = by_user[session->user_id];
+            owned.erase(find(owned.begin(), owned.end(), session));
+            if (owned.empty())
+            {
+                by_user.erase(session->user_id);
+                ended.push_back(session->user_id);
+            }
+
+            Shard &shard = shard_for(session->token);
+            unique_lock<shared_mutex> shard_lock(shard.mtx);
+            shard.table.erase(session->token);
+        }
+        return checked;
+    }
+};
+
+SessionRegistry sessions(chrono::hours(1));
+
+// --------------------------
+// Binary Wire Format
+// --------------------------
+// Frame layouts and the field helpers are in wire.h
+
+void encode_item(string &out, const Item &item)
+{
+    put_le(out, static_cast<int32_t>(item.id));
+    put_le(out, static_cast<uint8_t>(item.listing_type == "auction"));
+    put_le(out, item.current_bid);
+    put_le(out, item.fixed_price);
+    put_le(out, static_cast<int32_t>(item.inventory));
+    put_le(out, static_cast<int32_t>(item.bidder_id));
+    put_le(out, static_cast<int64_t>(item.end_time));
+    put_str(out, item.name);
+}
+
+void send_frame(ix::WebSocket &ws, const string &data, bool binary)
+{
+    if (binary)
+        ws.sendBinary(data);
+    else
+        ws.send(data);
+}
+
+// --------------------------
+// Broadcast Fan-out
+// --------------------------
+// Connections are spread across a few sender shards. broadcast() only drops
+// the frame into each shard's inbox; the shard's sender thread copies it into
+// every member's outbox and drains those outboxes, holding back from clients
+// whose socket buffer is already full. Nothing on the caller's thread ever
+// touches a socket. A slow client's queued ITEM_UPDATEs are coalesced per
+// item, so it only ever waits for the newest state of each; if what its
+// socket can't take still outgrows max_outbox it is disconnected rather than
+// silently missing frames such as AUCTION_ENDED.
+class BroadcastHub
+{
+private:
+    struct Outgoing
+    {
+        Frame frame;
+        bool binary;
+        int item_id;  // ITEM_UPDATE subject, or -1 for frames that never coalesce
+    };
+
+    // Only touched by the shard's sender thread
+    struct Client
+    {
+        shared_ptr<Connection> conn;
+        deque<Outgoing> outbox;
+        unordered_map<int, Outgoing *> queued_updates;  // item id -> its frame in outbox
+        bool evicted = false;
+    };
+
+    // One broadcast in each encoding; binary is null for text-only messages
+    struct Message
+    {
+        Frame text;
+        Frame binary;
+        int item_id;
+    };
+
+    struct Shard
+    {
+        mutex mtx;
+        condition_variable cv;
+        unordered_map<ix::WebSocket *, shared_ptr<Client>> clients;
+        vector<Message> inbox;
+        bool members_changed = false;
+        atomic<size_t> backlog{0};  // Frames waiting in members' outboxes
+        uint64_t published = 0;     // Messages ever put in the inbox
+        uint64_t handed_out = 0;    // ...and copied to every member's outbox
+        condition_variable handed_out_cv;
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    Histogram fanout_time{"ivory_broadcast_fanout_seconds", "",
+                          "Time for a sender shard to hand one batch of broadcasts to all its clients"};
+    size_t max_outbox = 1024;                    // frames kept for a slow client
+    size_t max_buffered_bytes = 4 * 1024 * 1024; // socket backlog before holding back
+
+    Shard &shard_for(ix::WebSocket *ws)
+    {
+        return *shards[hash<ix::WebSocket *>()(ws) % shards.size()];
+    }
+
+    // Sends queued frames until the outbox is empty or the socket backs up.
+    // Returns false if the client is gone.
+    bool drain(Client &client)
+    {
+        auto ws = client.conn->ws.lock();
+        if (!ws)
+            return false;
+        while (!client.outbox.empty() && ws->bufferedAmount() < max_buffered_bytes)
+        {
+            const Outgoing &next = client.outbox.front();
+            send_frame(*ws, *next.frame, next.binary);
+            if (next.item_id >= 0)
+                client.queued_updates.erase(next.item_id);
+            client.outbox.pop_front();
+        }
+        return true;
+    }
+
+    // Queues one frame, replacing a still-unsent update for the same item.
+    // Deque elements stay put on push_back and pop_front, so the pointers
+    // in queued_updates remain valid.
+    static void enqueue(Client &client, const Message &message)
+    {
+        bool binary = client.conn->binary && message.binary;
+        Outgoing frame{binary ? message.binary : message.text, binary, message.item_id};
+        if (message.item_id >= 0)
+        {
+            auto [it, inserted] = client.queued_updates.try_emplace(message.item_id, nullptr);
+            if (!inserted)
+            {
+                *it->second = move(frame);
+                return;
+            }
+            client.outbox.push_back(move(frame));
+            it->second = &client.outbox.back();
+            return;
+        }
+        client.outbox.push_back(move(frame));
+    }
+
+    // Closes a client that has fallen too far behind. The socket's Close
+    // callback removes it from the shard.
+    static void evict(Client &client)
+    {
+        client.evicted = true;
+        client.outbox.clear();
+        client.queued_updates.clear();
+        if (auto ws = client.conn->ws.lock())
+            ws->close(1008, "Too far behind on broadcasts");
+    }
+
+    void sender(Shard &shard)
+    {
+        vector<shared_ptr<Client>> members;
+        bool backlog = false;
+
+        while (true)
+        {
+            vector<Message> messages;
+            uint64_t taken;
+            {
+                unique_lock<mutex> lock(shard.mtx);
+                auto has_work = [&shard] { return !shard.inbox.empty() || shard.members_changed; };
+                if (backlog)
+                    shard.cv.wait_for(lock, chrono::milliseconds(10), has_work);
+                else
+                    shard.cv.wait(lock, has_work);
+
+                messages.swap(shard.inbox);
+                taken = shard.published;
+                if (shard.members_changed)
+                {
+                    members.clear();
+                    for (const auto &[key, client] : shard.clients)
+                        members.push_back(client);
+                    shard.members_changed = false;
+                }
+            }
+
+            auto fanout_started = chrono::steady_clock::now();
+            size_t waiting = 0;
+            backlog = false;
+            bool found_dead = false;
+            for (const auto &client : members)
+            {
+                if (client->evicted)
+                    continue;
+                for (const auto &message : messages)
+                {
+                    enqueue(*client, message);
+                }
+                // Only what the socket couldn't take counts against the client
+                if (!drain(*client))
+                {
+                    found_dead = true;
+                    continue;
+                }
+                if (client->outbox.size() > max_outbox)
+                {
+                    LOG_LIMITED(Warn, 1, "Disconnecting a client ", client->outbox.size(),
+                                " frames behind on broadcasts");
+                    evict(*client);
+                    continue;
+                }
+                if (!client->outbox.empty())
+                    backlog = true;
+                waiting += client->outbox.size();
+            }
+            if (!messages.empty())
+            {
+                fanout_time.record_since(fanout_started);
+                {
+                    lock_guard<mutex> lock(shard.mtx);
+                    shard.handed_out = taken;
+                }
+                shard.handed_out_cv.notify_all();
+            }
+            shard.backlog.store(waiting, memory_order_relaxed);
+
+            // Drop sockets that went away without a Close message
+            if (found_dead)
+            {
+                lock_guard<mutex> lock(shard.mtx);
+                for (auto it = shard.clients.begin(); it != shard.clients.end();)
+                {
+                    if (it->second->conn->ws.expired())
+                        it = shard.clients.erase(it);
+                    else
+                        ++it;
+                }
+                shard.members_changed = true;
+            }
+        }
+    }
+
+public:
+    void start(size_t senders)
+    {
+        for (size_t i = 0; i < senders; i++)
+        {
+            shards.push_back(make_unique<Shard>());
+        }
+        for (auto &shard : shards)
+        {
+            thread(&BroadcastHub::sender, this, ref(*shard)).detach();
+        }
+    }
+
+    void add(ix::WebSocket *ws, shared_ptr<Connection> conn)
+    {
+        Shard &shard = shard_for(ws);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            auto client = make_shared<Client>();
+            client->conn = move(conn);
+            shard.clients[ws] = move(client);
+            shard.members_changed = true;
+        }
+        shard.cv.notify_one();
+    }
+
+    void remove(ix::WebSocket *ws)
+    {
+        Shard &shard = shard_for(ws);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            shard.clients.erase(ws);
+            shard.members_changed = true;
+        }
+        shard.cv.notify_one();
+    }
+
+    size_t client_count()
+    {
+        size_t count = 0;
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> lock(shard->mtx);
+            count += shard->clients.size();
+        }
+        return count;
+    }
+
+    size_t backlog()
+    {
+        size_t frames = 0;
+        for (auto &shard : shards)
+            frames += shard->backlog.load(memory_order_relaxed);
+        return frames;
+    }
+
+    // item_id marks an ITEM_UPDATE, which a newer update for the same item
+    // may replace in a slow client's outbox
+    void publish(const Frame &text, const Frame &binary = nullptr, int item_id = -1)
+    {
+        for (auto &shard : shards)
+        {
+            {
+                lock_guard<mutex> lock(shard->mtx);
+                shard->inbox.push_back({text, binary, item_id});
+                shard->published++;
+            }
+            shard->cv.notify_one();
+        }
+    }
+
+    void wait_handed_out()
+    {
+        for (auto &shard : shards)
+        {
+            unique_lock<mutex> lock(shard->mtx);
+            uint64_t target = shard->published;
+            shard->handed_out_cv.wait(lock, [&] { return shard->handed_out >= target; });
+        }
+    }
+};
+
+BroadcastHub broadcast_hub;
+
+void broadcast(const string &message)
+{
+    broadcast_hub.publish(make_shared<const string>(message));
+}
+
+void wait_for_broadcasts()
+{
+    broadcast_hub.wait_handed_out();
+}
+
+void connect_client(ix::WebSocket *ws, shared_ptr<Connection> conn)
+{
+    broadcast_hub.add(ws, move(conn));
+}
+
+void disconnect_client(ix::WebSocket *ws)
+{
+    broadcast_hub.remove(ws);
+}
+
+// ITEM_UPDATE in both encodings, built once for every recipient
+struct ItemUpdate
+{
+    Frame text;
+    Frame binary;
+    int item_id;
+};
+
+// Requires a freshly touched item so the cached wire entry and record are current
+ItemUpdate item_update(const Item &item)
+{
+    string binary = wire_header(WireType::ItemUpdate);
+    put_le(binary, item.changed_at);
+    return {make_shared<const string>("ITEM_UPDATE|" + to_string(item.changed_at) + "|" + item.wire),
+            make_shared<const string>(binary + item.record),
+            item.id};
+}
+
+void broadcast(const ItemUpdate &update)
+{
+    broadcast_hub.publish(update.text, update.binary, update.item_id);
+}
+
+Frame item_update_frame(int item_id, bool binary)
+{
+    auto lock = items_monitor.get_lock();
+    auto it = items.find(item_id);
+    if (it == items.end())
+        return nullptr;
+    ItemUpdate update = item_update(it->second);
+    return binary ? update.binary : update.text;
+}
+
+// --------------------------
+// Catalog Versioning
+// --------------------------
+// Every change to an Item bumps a global catalog version and re-serializes
+// that one item. Full ITEMS_LIST / ITEMS_SNAPSHOT frames are built at most
+// once per version, and a bounded change log lets GET_ITEMS_SINCE answer
+// with just the items that changed. All members require items_monitor.
+//
+// A version is a random per-process epoch above a 32-bit counter, kept under
+// 2^53 so JavaScript clients can hold it as a number. Items are renumbered
+// when the server restarts or reseeds, so a version from another process is
+// always answered with a full snapshot. Every ITEM_UPDATE carries the version
+// of its change, letting clients drop one that arrives after newer state.
+class Catalog
+{
+private:
+    static constexpr size_t max_log = 4096;
+    static constexpr int epoch_bits = 21;
+
+    static uint64_t new_epoch()
+    {
+        random_device rd;
+        uint64_t epoch = 0;
+        while (epoch == 0)  // Zero would match a client that has never synced
+            epoch = rd() & ((uint64_t(1) << epoch_bits) - 1);
+        return epoch << 32;
+    }
+
+    uint64_t version = new_epoch();
+    uint64_t log_floor = version;          // oldest version the log can diff from
+    deque<pair<uint64_t, int>> change_log; // (version, item_id)
+    uint64_t text_version = UINT64_MAX;
+    Frame list_frame;
+    Frame snapshot_frame;
+    uint64_t binary_version = UINT64_MAX;  // binary frames are only built once asked for
+    Frame list_binary;
+    Frame snapshot_binary;
+
+    void build_text_frames(const unordered_map<int, Item> &all)
+    {
+        string body;
+        for (const auto &[id, item] : all)
+        {
+            body += '|';
+            body += item.wire;
+        }
+        list_frame = make_shared<const string>("ITEMS_LIST" + body);
+        snapshot_frame = make_shared<const string>("ITEMS_SNAPSHOT|" + to_string(version) + body);
+        text_version = version;
+    }
+
+    void build_binary_frames(const unordered_map<int, Item> &all)
+    {
+        string body;
+        put_le(body, static_cast<uint32_t>(all.size()));
+        for (const auto &[id, item] : all)
+            body += item.record;
+
+        string snapshot = wire_header(WireType::ItemsSnapshot);
+        put_le(snapshot, version);
+        list_binary = make_shared<const string>(wire_header(WireType::ItemsList) + body);
+        snapshot_binary = make_shared<const string>(snapshot + body);
+        binary_version = version;
+    }
+
+    Frame snapshot(const unordered_map<int, Item> &all, bool binary)
+    {
+        if (binary)
+        {
+            if (binary_version != version)
+                build_binary_frames(all);
+            return snapshot_binary;
+        }
+        if (text_version != version)
+            build_text_frames(all);
+        return snapshot_frame;
+    }
+
+public:
+    static string serialize(const Item &item)
+    {
+        return to_string(item.id) + "," + item.name + "," 
+             + item.listing_type + "," + to_string(item.current_bid) + "," 
+             + to_string(item.fixed_price) + "," + to_string(item.inventory) + ","
+             + to_string(item.bidder_id) + "," + to_string(item.end_time);
+    }
+
+    static void refresh(Item &item)
+    {
+        item.wire = serialize(item);
+        item.record.clear();
+        encode_item(item.record, item);
+    }
+
+    uint64_t current() const { return version; }
+
+    // Records a change to one item
+    void touch(Item &item)
+    {
+        refresh(item);
+        item.changed_at = ++version;
+        change_log.emplace_back(version, item.id);
+        if (change_log.size() > max_log)
+        {
+            log_floor = change_log.front().first;
+            change_log.pop_front();
+        }
+    }
+
+    // Starts a fresh history after a full reload; older clients resync
+    void reset(unordered_map<int, Item> &all)
+    {
+        change_log.clear();
+        log_floor = ++version;
+        for (auto &[id, item] : all)
+        {
+            refresh(item);
+            item.changed_at = version;
+        }
+    }
+
+    Frame items_list(const unordered_map<int, Item> &all, bool binary)
+    {
+        if (binary)
+        {
+            if (binary_version != version)
+                build_binary_frames(all);
+            return list_binary;
+        }
+        if (text_version != version)
+            build_text_frames(all);
+        return list_frame;
+    }
+
+    // Items changed after `since` as an ITEMS_DELTA frame, or the whole
+    // catalog as ITEMS_SNAPSHOT when the log no longer reaches back that far
+    Frame changes_since(uint64_t since, const unordered_map<int, Item> &all, bool binary)
+    {
+        if ((since >> 32) != (version >> 32) || since < log_floor || since > version)
+            return snapshot(all, binary);
+
+        auto first = upper_bound(change_log.begin(), change_log.end(), make_pair(since, INT_MAX));
+        unordered_set<int> seen;
+        vector<const Item *> changed;
+        for (auto it = first; it != change_log.end(); ++it)
+        {
+            if (!seen.insert(it->second).second)
+                continue;
+            if (auto item = all.find(it->second); item != all.end())
+                changed.push_back(&item->second);
+        }
+
+        string delta;
+        if (binary)
+        {
+            delta = wire_header(WireType::ItemsDelta);
+            put_le(delta, version);
+            put_le(delta, static_cast<uint32_t>(changed.size()));
+            for (const Item *item : changed)
+                delta += item->record;
+        }
+        else
+        {
+            delta = "ITEMS_DELTA|" + to_string(version);
+            for (const Item *item : changed)
+            {
+                delta += '|';
+                delta += item->wire;
+            }
+        }
+        return make_shared<const string>(move(delta));
+    }
+};
+
+Catalog catalog;
+
+// --------------------------
+// Bid Journal
+// --------------------------
+// The in-memory Item is the authority for current_bid, bidder_id and version.
+// Each entry is one coalesced burst of bids on an item: every competing bid
+// goes to the bids history, and only the winner updates the items row.
+// Entries are written to SQLite in batches by a single flusher, every
+// flush_interval or as soon as max_batch bids are waiting. Bidders are acked
+// and ITEM_UPDATEs broadcast only once a batch has committed. A batch SQLite
+// keeps refusing is abandoned after max_attempts: its bidders get an ERROR
+// and its items go back to their last durable bid.
+struct BidRecord
+{
+    int user_id;
+    double amount;
+    weak_ptr<ix::WebSocket> ws;
+    chrono::steady_clock::time_point received;
+};
+
+struct BidBurst
+{
+    int item_id;
+    vector<BidRecord> bids;  // every bid that beat the price the burst started at
+    size_t winner;           // index into bids
+    int version;
+    double previous_bid;     // the item before this burst, to roll back to
+    int previous_bidder;
+    ItemUpdate update;       // the item after this burst
+};
+
+class BidJournal
+{
+private:
+    mutex mtx;
+    condition_variable cv;
+    condition_variable durable_cv;
+    vector<BidBurst> pending;
+    size_t pending_bids = 0;
+    bool flushing = false;
+    chrono::milliseconds flush_interval{5};
+    size_t max_batch = 512;
+    int max_attempts = 5;
+    Histogram transaction_time = db_transaction_histogram("bid_journal");
+    Histogram bid_latency{"ivory_bid_to_broadcast_seconds", "",
+                          "Time from a bid arriving to its ack and ITEM_UPDATE being sent"};
+
+    bool write_batch(const vector<BidBurst> &batch)
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        ScopedTimer timer(transaction_time);
+        if (!db.exec(Stmt::Begin))
+            return false;
+
+        // Only the newest burst per item needs to reach the items row
+        unordered_map<int, const BidBurst *> latest;
+        for (const auto &burst : batch)
+        {
+            for (const auto &bid : burst.bids)
+            {
+                auto insert_stmt = db.statement(Stmt::InsertBid);
+                sqlite3_bind_int(insert_stmt, 1, burst.item_id);
+                sqlite3_bind_int(insert_stmt, 2, bid.user_id);
+                sqlite3_bind_double(insert_stmt, 3, bid.amount);
+                if (sqlite3_step(insert_stmt) != SQLITE_DONE)
+                {
+                    db.exec(Stmt::Rollback);
+                    return false;
+                }
+            }
+            latest[burst.item_id] = &burst;
+        }
+
+        for (const auto &[item_id, burst] : latest)
+        {
+            const BidRecord &winner = burst->bids[burst->winner];
+            auto update_stmt = db.statement(Stmt::UpdateBid);
+            sqlite3_bind_double(update_stmt, 1, winner.amount);
+            sqlite3_bind_int(update_stmt, 2, winner.user_id);
+            sqlite3_bind_int(update_stmt, 3, burst->version);
+            sqlite3_bind_int(update_stmt, 4, item_id);
+            if (sqlite3_step(update_stmt) != SQLITE_DONE)
+            {
+                db.exec(Stmt::Rollback);
+                return false;
+            }
+        }
+
+        if (db.exec(Stmt::Commit))
+            return true;
+        // A failed COMMIT leaves the transaction open on the shared writer
+        db.exec(Stmt::Rollback);
+        return false;
+    }
+
+    void flusher()
+    {
+        while (true)
+        {
+            vector<BidBurst> batch;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [this] { return !pending.empty(); });
+                cv.wait_for(lock, flush_interval, [this] { return pending_bids >= max_batch; });
+                batch.swap(pending);
+                pending_bids = 0;
+                flushing = true;
+            }
+
+            bool written = false;
+            for (int attempt = 1; !written && attempt <= max_attempts; attempt++)
+            {
+                written = write_batch(batch);
+                if (!written)
+                {
+                    LOG_LIMITED(Error, 1, "Bid journal flush failed: ", sqlite3_errmsg(db.handle));
+                    this_thread::sleep_for(flush_interval * attempt);
+                }
+            }
+            if (!written)
+            {
+                abandon(batch);
+                finish_flush();
+                continue;
+            }
+
+            // Ack every bidder, but broadcast each item only at its newest state
+            unordered_map<int, const ItemUpdate *> updates;
+            for (const auto &burst : batch)
+            {
+                const BidRecord &winner = burst.bids[burst.winner];
+                for (size_t i = 0; i < burst.bids.size(); i++)
+                {
+                    auto ws = burst.bids[i].ws.lock();
+                    if (!ws)
+                        continue;
+                    if (i == burst.winner)
+                        ws->send("ACK|Bid accepted");
+                    else
+                        ws->send("ERROR|Outbid on item " + to_string(burst.item_id) +
+                                 ": winning bid is " + to_string(winner.amount));
+                }
+                updates[burst.item_id] = &burst.update;
+            }
+            for (const auto &[item_id, update] : updates)
+            {
+                broadcast(*update);
+            }
+            for (const auto &burst : batch)
+            {
+                for (const auto &bid : burst.bids)
+                    bid_latency.record_since(bid.received);
+            }
+
+            finish_flush();
+        }
+    }
+
+    void finish_flush()
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            flushing = false;
+        }
+        durable_cv.notify_all();
+    }
+
+    // Puts each item back to the bid it had before this batch, unless newer
+    // bids have been accepted on it since (they will carry their own state to
+    // SQLite) or its auction has already closed on the in-memory winner.
+    void abandon(const vector<BidBurst> &batch)
+    {
+        LOG(Error, "Dropping ", batch.size(), " bid bursts after ", max_attempts, " failed flushes");
+
+        unordered_map<int, pair<const BidBurst *, const BidBurst *>> bursts;  // first, last per item
+        for (const auto &burst : batch)
+        {
+            auto [it, inserted] = bursts.try_emplace(burst.item_id, &burst, &burst);
+            if (!inserted)
+                it->second.second = &burst;
+        }
+
+        vector<ItemUpdate> updates;
+        {
+            auto lock = items_monitor.get_lock();
+            for (const auto &[item_id, range] : bursts)
+            {
+                auto it = items.find(item_id);
+                if (it == items.end() || it->second.version != range.second->version ||
+                    it->second.inventory <= 0)
+                {
+                    continue;
+                }
+                it->second.current_bid = range.first->previous_bid;
+                it->second.bidder_id = range.first->previous_bidder;
+                catalog.touch(it->second);
+                updates.push_back(item_update(it->second));
+            }
+        }
+
+        for (const auto &burst : batch)
+        {
+            string error = "ERROR|Bid on item " + to_string(burst.item_id) + " could not be saved";
+            for (const auto &bid : burst.bids)
+            {
+                if (auto ws = bid.ws.lock())
+                    ws->send(error);
+            }
+        }
+        for (const auto &update : updates)
+            broadcast(update);
+    }
+
+public:
+    void start(chrono::milliseconds interval, size_t batch_size)
+    {
+        flush_interval = interval;
+        max_batch = batch_size;
+        thread(&BidJournal::flusher, this).detach();
+    }
+
+    void append(BidBurst burst)
+    {
+        bool wake;
+        {
+            lock_guard<mutex> lock(mtx);
+            wake = pending.empty();
+            pending_bids += burst.bids.size();
+            pending.push_back(move(burst));
+            wake = wake || pending_bids >= max_batch;
+        }
+        if (wake)
+            cv.notify_one();
+    }
+
+    size_t depth()
+    {
+        lock_guard<mutex> lock(mtx);
+        return pending_bids;
+    }
+
+    // Blocks until every burst appended so far has been committed
+    void wait_durable()
+    {
+        unique_lock<mutex> lock(mtx);
+        durable_cv.wait(lock, [this] { return pending.empty() && !flushing; });
+    }
+};
+
+BidJournal bid_journal;
+
+// --------------------------
+// Auction Scheduler
+// --------------------------
+// Min-heap of auction deadlines. The scheduler thread sleeps until the
+// earliest end_time and hands only the due auctions to on_due. Entries are
+// never removed in place: an auction whose end_time changed is simply
+// scheduled again, and on_due ignores deadlines that no longer match.
+class AuctionScheduler
+{
+private:
+    using Deadline = pair<int64_t, int>;  // (end_time, item_id)
+
+    mutex mtx;
+    condition_variable cv;
+    priority_queue<Deadline, vector<Deadline>, greater<Deadline>> deadlines;
+    function<void(int, int64_t)> on_due;
+
+    void run()
+    {
+        unique_lock<mutex> lock(mtx);
+        while (true)
+        {
+            if (deadlines.empty())
+            {
+                cv.wait(lock);
+                continue;
+            }
+
+            auto [end_time, item_id] = deadlines.top();
+            auto due = chrono::system_clock::from_time_t(end_time);
+            if (chrono::system_clock::now() < due)
+            {
+                cv.wait_until(lock, due);
+                continue;
+            }
+
+            deadlines.pop();
+            lock.unlock();
+            on_due(item_id, end_time);
+            lock.lock();
+        }
+    }
+
+public:
+    void start(function<void(int, int64_t)> callback)
+    {
+        on_due = move(callback);
+        thread(&AuctionScheduler::run, this).detach();
+    }
+
+    void schedule(int item_id, int64_t end_time)
+    {
+        bool earliest;
+        {
+            lock_guard<mutex> lock(mtx);
+            deadlines.emplace(end_time, item_id);
+            earliest = deadlines.top() == Deadline(end_time, item_id);
+        }
+        if (earliest)
+            cv.notify_one();
+    }
+
+    // Replaces every pending deadline, e.g. after a full catalog reload
+    void reset(vector<Deadline> all)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            deadlines = decltype(deadlines)(greater<Deadline>(), move(all));
+        }
+        cv.notify_one();
+    }
+};
+
+AuctionScheduler auction_scheduler;
+
+// --------------------------
+// Inventory Reservations
+// --------------------------
+// Per-item stock split into atomic available / reserved counters, so that
+// holding units for a cart or an order is a compare-and-swap and never a
+// query. Units move available -> reserved when a user holds them and leave
+// reserved when they are sold; on-hand stock is always the sum of the two, so
+// nothing can be held, let alone sold, twice. The item table is published
+// copy-on-write and read lock-free. Counters are only ever changed under the
+// holder's shard lock, so reset() can stop every change by taking them all.
+//
+// Holds belong to a (user, item) pair and lapse after ttl. An expired hold
+// only returns its units to the pool: the cart line stays, and checkout
+// reclaims the units (or fails) when the order is placed. Sales reach SQLite
+// through the checkout pipeline's batched transactions.
+class InventoryEngine
+{
+private:
+    using Clock = chrono::steady_clock;
+
+    struct Stock
+    {
+        atomic<int> available{0};
+        atomic<int> reserved{0};
+    };
+
+    struct Hold
+    {
+        int quantity = 0;
+        Clock::time_point expires;
+    };
+
+    struct HoldShard
+    {
+        mutex mtx;
+        unordered_map<uint64_t, Hold> holds;  // key: user_id << 32 | item_id
+        priority_queue<pair<Clock::time_point, uint64_t>, vector<pair<Clock::time_point, uint64_t>>,
+                       greater<pair<Clock::time_point, uint64_t>>> deadlines;
+    };
+
+    using Table = unordered_map<int, shared_ptr<Stock>>;
+    static constexpr size_t shard_count = 16;
+
+    shared_ptr<const Table> table = make_shared<const Table>();
+    atomic<uint64_t> generation{0};
+    mutex table_mtx;  // Writers only
+    array<HoldShard, shard_count> shards;
+    Clock::duration ttl = chrono::minutes(15);
+
+    static uint64_t key(int user_id, int item_id)
+    {
+        return uint64_t(uint32_t(user_id)) << 32 | uint32_t(item_id);
+    }
+
+    HoldShard &shard_for(int user_id)
+    {
+        return shards[static_cast<unsigned>(user_id) % shard_count];
+    }
+
+    shared_ptr<Stock> find(int item_id)
+    {
+        thread_local pair<uint64_t, shared_ptr<const Table>> cache;
+        uint64_t current = generation.load(memory_order_acquire);
+        if (!cache.second || cache.first != current)
+        {
+            cache.second = atomic_load(&table);
+            cache.first = current;
+        }
+        auto it = cache.second->find(item_id);
+        return it != cache.second->end() ? it->second : nullptr;
+    }
+
+    // Requires table_mtx
+    void publish(shared_ptr<const Table> next)
+    {
+        atomic_store(&table, move(next));
+        generation.fetch_add(1, memory_order_release);
+    }
+
+    static bool take(Stock &stock, int quantity)
+    {
+        int available = stock.available.load(memory_order_relaxed);
+        do
+        {
+            if (available < quantity)
+                return false;
+        } while (!stock.available.compare_exchange_weak(available, available - quantity,
+                                                        memory_order_acq_rel, memory_order_relaxed));
+        stock.reserved.fetch_add(quantity, memory_order_relaxed);
+        return true;
+    }
+
+    static void give_back(Stock &stock, int quantity)
+    {
+        stock.reserved.fetch_sub(quantity, memory_order_relaxed);
+        stock.available.fetch_add(quantity, memory_order_release);
+    }
+
+    // Units currently held against each item; requires every shard lock
+    unordered_map<int, int> held_totals()
+    {
+        unordered_map<int, int> totals;
+        for (auto &shard : shards)
+        {
+            for (const auto &[k, hold] : shard.holds)
+                totals[static_cast<int>(uint32_t(k))] += hold.quantity;
+        }
+        return totals;
+    }
+
+    void expire_loop()
+    {
+        while (true)
+        {
+            this_thread::sleep_for(chrono::seconds(1));
+            auto now = Clock::now();
+            for (auto &shard : shards)
+            {
+                lock_guard<mutex> lock(shard.mtx);
+                while (!shard.deadlines.empty() && shard.deadlines.top().first <= now)
+                {
+                    auto [expires, k] = shard.deadlines.top();
+                    shard.deadlines.pop();
+                    auto it = shard.holds.find(k);
+                    if (it == shard.holds.end() || it->second.expires != expires)
+                        continue;  // Renewed or released since
+                    if (auto stock = find(static_cast<int>(uint32_t(k))))
+                        give_back(*stock, it->second.quantity);
+                    shard.holds.erase(it);
+                }
+            }
+        }
+    }
+
+public:
+    void start(Clock::duration hold_ttl)
+    {
+        ttl = hold_ttl;
+        thread(&InventoryEngine::expire_loop, this).detach();
+    }
+
+    // Rebuilds every counter from on-hand stock, keeping existing holds. All
+    // hold shards stay locked from the snapshot to the publish, so no hold
+    // can land on the old table and later be given back to the new one.
+    void reset(const vector<pair<int, int>> &on_hand)
+    {
+        vector<unique_lock<mutex>> frozen;
+        for (auto &shard : shards)
+            frozen.emplace_back(shard.mtx);
+
+        auto held = held_totals();
+        auto next = make_shared<Table>();
+        for (const auto &[item_id, quantity] : on_hand)
+        {
+            auto stock = make_shared<Stock>();
+            int reserved = held.count(item_id) ? held[item_id] : 0;
+            stock->reserved = reserved;
+            stock->available = max(0, quantity - reserved);
+            (*next)[item_id] = move(stock);
+        }
+        lock_guard<mutex> lock(table_mtx);
+        publish(move(next));
+    }
+
+    void track(int item_id, int on_hand)
+    {
+        lock_guard<mutex> lock(table_mtx);
+        auto next = make_shared<Table>(*atomic_load(&table));
+        auto stock = make_shared<Stock>();
+        stock->available = on_hand;
+        (*next)[item_id] = move(stock);
+        publish(move(next));
+    }
+
+    int available(int item_id)
+    {
+        auto stock = find(item_id);
+        return stock ? stock->available.load(memory_order_acquire) : 0;
+    }
+
+    // Sets the user's hold on an item to exactly quantity units, or adds
+    // quantity units to it if extra is set, and restarts its ttl. Fails,
+    // leaving the hold as it was, if the extra units are not available.
+    // previous, if given, receives the hold's size before the call.
+    bool hold(int user_id, int item_id, int quantity, bool extra = false, int *previous = nullptr)
+    {
+        HoldShard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        auto stock = find(item_id);  // Under the lock, so reset() can't swap it
+        uint64_t k = key(user_id, item_id);
+        auto it = shard.holds.find(k);
+        int current = it != shard.holds.end() ? it->second.quantity : 0;
+        if (previous)
+            *previous = current;
+        if (!stock)
+            return quantity <= 0;
+        if (extra)
+            quantity += current;
+
+        if (quantity > current && !take(*stock, quantity - current))
+            return false;
+        if (quantity < current)
+            give_back(*stock, current - quantity);
+
+        if (quantity <= 0)
+        {
+            if (it != shard.holds.end())
+                shard.holds.erase(it);
+            return true;
+        }
+        Hold &h = shard.holds[k];
+        h.quantity = quantity;
+        h.expires = Clock::now() + ttl;
+        shard.deadlines.emplace(h.expires, k);
+        return true;
+    }
+
+    // Turns held units into sold ones once their order has committed
+    void sell(int user_id, int item_id, int quantity)
+    {
+        HoldShard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        auto stock = find(item_id);
+        auto it = shard.holds.find(key(user_id, item_id));
+        if (it == shard.holds.end())
+            return;
+        int sold = min(quantity, it->second.quantity);
+        if (stock)
+            stock->reserved.fetch_sub(sold, memory_order_relaxed);
+        it->second.quantity -= sold;
+        if (it->second.quantity <= 0)
+            shard.holds.erase(it);
+    }
+};
+
+InventoryEngine inventory;
+
+// --------------------------
+// Database Operations
+// --------------------------
+int authenticate_user(const string &username, const string &password)
+{
+    auto conn = read_pool.acquire();
+    auto stmt = conn->statement(Stmt::AuthenticateUser);
+
+    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, password.c_str(), -1, SQLITE_STATIC);
+
+    int user_id = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        user_id = sqlite3_column_int(stmt, 0);
+    }
+
+    return user_id;
+}
+
+string join(const vector<string> &vec, const string &delimiter) {
+    stringstream ss;
+    for (size_t i = 0; i < vec.size(); ++i) {
+        if (i > 0) ss << delimiter;
+        ss << vec[i];
+    }
+    return ss.str();
+}
+
+// Full reload of the items map. Only used at startup and by the admin
+// RELOAD_ITEMS command; normal writes patch the map in place below.
+void load_items_from_db()
+{
+    // Most accepted bids reach SQLite here; later ones are carried over below
+    bid_journal.wait_durable();
+
+    unordered_map<int, Item> loaded;
+    {
+        auto conn = read_pool.acquire();
+        auto stmt = conn->statement(Stmt::LoadItems);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            Item item;
+            item.id = sqlite3_column_int(stmt, 0);
+            item.name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        
+            // Description might be NULL
+            if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+                item.description = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+            }
+        
+            item.listing_type = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+            item.current_bid = sqlite3_column_double(stmt, 4);
+            item.fixed_price = sqlite3_column_double(stmt, 5);
+            item.inventory = sqlite3_column_int(stmt, 6);
+            item.bidder_id = sqlite3_column_int(stmt, 7);
+            item.end_time = sqlite3_column_int64(stmt, 8);
+            item.version = sqlite3_column_int(stmt, 9);
+        
+            loaded[item.id] = move(item);
+        }
+    }
+
+    vector<pair<int64_t, int>> deadlines;
+    vector<pair<int, int>> on_hand;
+    for (const auto &[id, item] : loaded)
+    {
+        if (item.listing_type == "auction" && item.end_time > 0 && item.inventory > 0)
+            deadlines.emplace_back(item.end_time, id);
+        if (item.listing_type == "fixed")
+            on_hand.emplace_back(id, item.inventory);
+    }
+
+    {
+        auto lock = items_monitor.get_lock();
+        // Bids accepted after the drain are still on their way to SQLite; the
+        // in-memory item stays the authority for them. Item versions only
+        // move with bids, so a newer version means a newer bid.
+        for (auto &[id, item] : loaded)
+        {
+            auto it = items.find(id);
+            if (it != items.end() && it->second.version > item.version)
+            {
+                item.current_bid = it->second.current_bid;
+                item.bidder_id = it->second.bidder_id;
+                item.version = it->second.version;
+            }
+        }
+        catalog.reset(loaded);
+        items.swap(loaded);
+    }
+    auction_scheduler.reset(move(deadlines));
+    inventory.reset(on_hand);
+}
+
+// --------------------------
+// In-place Item Updates
+// --------------------------
+// Applied once the matching database write has committed, so the map only
+// ever reflects durable state.
+void on_item_added(Item item)
+{
+    if (item.listing_type == "auction" && item.end_time > 0)
+        auction_scheduler.schedule(item.id, item.end_time);
+    if (item.listing_type == "fixed")
+        inventory.track(item.id, item.inventory);
+
+    ItemUpdate update;
+    {
+        auto lock = items_monitor.get_lock();
+        Item &added = items[item.id] = move(item);
+        catalog.touch(added);
+        update = item_update(added);
+    }
+    broadcast(update);
+}
+
+void on_items_sold(const vector<pair<Item, int>> &sold)
+{
+    vector<ItemUpdate> updates;
+    {
+        auto lock = items_monitor.get_lock();
+        for (const auto &[item, quantity] : sold)
+        {
+            if (item.listing_type != "fixed")
+                continue;
+            if (auto it = items.find(item.id); it != items.end())
+            {
+                it->second.inventory -= quantity;
+                catalog.touch(it->second);
+                updates.push_back(item_update(it->second));
+            }
+        }
+    }
+    for (const auto &update : updates)
+        broadcast(update);
+}
+
+// Closes an auction to further bids and returns its closed state (winning bid
+// and bidder intact), or nothing if the deadline is stale (the auction was
+// rescheduled or already settled).
+optional<Item> close_auction(int item_id, int64_t end_time)
+{
+    auto lock = items_monitor.get_lock();
+    auto it = items.find(item_id);
+    if (it == items.end() || it->second.listing_type != "auction" ||
+        it->second.end_time != end_time || it->second.inventory <= 0)
+    {
+        return nullopt;
+    }
+
+    it->second.end_time = 0;
+    it->second.inventory = 0;
+    catalog.touch(it->second);
+    return it->second;
+}
+
+void seed_test_data()
+{
+    lock_guard<mutex> db_lock(db_mutex);
+    // In production: Use proper password hashing (e.g., bcrypt)
+    const char *users_sql =
+        "INSERT OR IGNORE INTO users (id, username, password_hash, is_admin) VALUES "
+        "(1, 'admin', 'admin', 1), "
+        "(2, 'user1', 'pass1', 0), "
+        "(3, 'user2', 'pass2', 0);";
+    sqlite3_exec(db.handle, users_sql, 0, 0, 0);
+
+    // Get current time
+    int64_t now = time(nullptr);
+    int64_t one_day = 24 * 60 * 60;
+    
+    // Clear existing items
+    sqlite3_exec(db.handle, "DELETE FROM items", 0, 0, 0);
+    
+    // Create some auction items
+    sqlite3_stmt *auction_stmt;
+    const char *auction_sql = 
+        "INSERT INTO items (name, description, listing_type, current_bid, inventory, end_time) VALUES "
+        "(?, ?, 'auction', ?, 1, ?)";
+    
+    if (sqlite3_prepare_v2(db.handle, auction_sql, -1, &auction_stmt, nullptr) == SQLITE_OK)
+    {
+        // Item 1: Ending in 1 hour
+        sqlite3_bind_text(auction_stmt, 1, "Antique Chair", -1, SQLITE_STATIC);
+        sqlite3_bind_text(auction_stmt, 2, "A beautiful handcrafted chair from the 18th century", -1, SQLITE_STATIC);
+        sqlite3_bind_double(auction_stmt, 3, 100.0);
+        sqlite3_bind_int64(auction_stmt, 4, now + 3600);  // 1 hour from now
+        sqlite3_step(auction_stmt);
+        sqlite3_reset(auction_stmt);
+        
+        // Item 2: Ending in 1 day
+        sqlite3_bind_text(auction_stmt, 1, "Vintage Painting", -1, SQLITE_STATIC);
+        sqlite3_bind_text(auction_stmt, 2, "An original oil painting from a renowned artist", -1, SQLITE_STATIC);
+        sqlite3_bind_double(auction_stmt, 3, 500.0);
+        sqlite3_bind_int64(auction_stmt, 4, now + one_day);
+        sqlite3_step(auction_stmt);
+        sqlite3_reset(auction_stmt);
+        
+        // Item 3: Ending in 3 days
+        sqlite3_bind_text(auction_stmt, 1, "Rare Coin Collection", -1, SQLITE_STATIC);
+        sqlite3_bind_text(auction_stmt, 2, "A collection of rare coins from around the world", -1, SQLITE_STATIC);
+        sqlite3_bind_double(auction_stmt, 3, 1000.0);
+        sqlite3_bind_int64(auction_stmt, 4, now + 3 * one_day);
+        sqlite3_step(auction_stmt);
+        
+        sqlite3_finalize(auction_stmt);
+    }
+    
+    // Create some fixed-price items
+    sqlite3_stmt *fixed_stmt;
+    const char *fixed_sql = 
+        "INSERT INTO items (name, description, listing_type, fixed_price, inventory) VALUES "
+        "(?, ?, 'fixed', ?, ?)";
+    
+    if (sqlite3_prepare_v2(db.handle, fixed_sql, -1, &fixed_stmt, nullptr) == SQLITE_OK)
+    {
+        // Item 1
+        sqlite3_bind_text(fixed_stmt, 1, "Designer Watch", -1, SQLITE_STATIC);
+        sqlite3_bind_text(fixed_stmt, 2, "A luxury watch with premium materials", -1, SQLITE_STATIC);
+        sqlite3_bind_double(fixed_stmt, 3, 299.99);
+        sqlite3_bind_int(fixed_stmt, 4, 5);
+        sqlite3_step(fixed_stmt);
+        sqlite3_reset(fixed_stmt);
+        
+        // Item 2
+        sqlite3_bind_text(fixed_stmt, 1, "Smartphone", -1, SQLITE_STATIC);
+        sqlite3_bind_text(fixed_stmt, 2, "The latest smartphone with advanced features", -1, SQLITE_STATIC);
+        sqlite3_bind_double(fixed_stmt, 3, 699.99);
+        sqlite3_bind_int(fixed_stmt, 4, 10);
+        sqlite3_step(fixed_stmt);
+        sqlite3_reset(fixed_stmt);
+        
+        // Item 3
+        sqlite3_bind_text(fixed_stmt, 1, "Leather Jacket", -1, SQLITE_STATIC);
+        sqlite3_bind_text(fixed_stmt, 2, "A genuine leather jacket, perfect for all seasons", -1, SQLITE_STATIC);
+        sqlite3_bind_double(fixed_stmt, 3, 199.99);
+        sqlite3_bind_int(fixed_stmt, 4, 8);
+        sqlite3_step(fixed_stmt);
+        
+        sqlite3_finalize(fixed_stmt);
+    }
+}
+
+// --------------------------
+// Bid Processing & Cart Operations
+// --------------------------
+// Settles a whole burst of queued bids on one item at once: the highest bid
+// that beats the current price wins, every other competing bid is reported
+// as outbid, and the item is updated and broadcast a single time.
+void process_bids(int item_id, vector<PendingBid> &bids)
+{
+    string rejection;
+    vector<weak_ptr<ix::WebSocket>> rejected;
+    auto reject_all = [&](const char *reason)
+    {
+        rejection = reason;
+        for (auto &bid : bids)
+            rejected.push_back(move(bid.ws));
+    };
+
+    {
+        auto lock = items_monitor.get_lock();
+        auto it = items.find(item_id);
+
+        // Don't process bids for non-auction items or ended auctions
+        if (it == items.end()) {
+            reject_all("ERROR|Invalid item ID");
+        } else if (it->second.listing_type != "auction") {
+            reject_all("ERROR|Item is not an auction");
+        } else if ((it->second.end_time > 0 && it->second.end_time < time(nullptr)) ||
+                   it->second.inventory <= 0) {
+            reject_all("ERROR|Auction has ended");
+        } else {
+            Item &item = it->second;
+            rejection = "ERROR|Bid must be higher than current bid";
+
+            BidBurst burst;
+            burst.item_id = item_id;
+            burst.winner = 0;
+            for (auto &bid : bids)
+            {
+                if (bid.amount <= item.current_bid)
+                {
+                    rejected.push_back(move(bid.ws));
+                    continue;
+                }
+                // Ties go to the earlier bid
+                if (burst.bids.empty() || bid.amount > burst.bids[burst.winner].amount)
+                    burst.winner = burst.bids.size();
+                burst.bids.push_back({bid.user_id, bid.amount, move(bid.ws), bid.received});
+            }
+
+            if (!burst.bids.empty())
+            {
+                const BidRecord &winner = burst.bids[burst.winner];
+                burst.previous_bid = item.current_bid;
+                burst.previous_bidder = item.bidder_id;
+                item.current_bid = winner.amount;
+                item.bidder_id = winner.user_id;
+                item.version++;
+                catalog.touch(item);
+
+                burst.version = item.version;
+                burst.update = item_update(item);
+                bid_journal.append(move(burst));
+            }
+        }
+    }
+
+    // Rejected bids need no durability, so answer them right away
+    for (const auto &ws : rejected)
+    {
+        if (auto ws_ptr = ws.lock())
+        {
+            ws_ptr->send(rejection);
+        }
+    }
+}
+
+// --------------------------
+// Bid Engine
+// --------------------------
+// Bids are partitioned by item id across a fixed set of shards, each drained
+// by its own worker. All bids for one item land on the same shard and the
+// worker takes an item's whole queue at once, so bursts are settled together
+// in arrival order while different auctions run in parallel.
+class BidEngine
+{
+private:
+    struct Shard
+    {
+        mutex mtx;
+        condition_variable cv;
+        unordered_map<int, vector<PendingBid>> pending;  // bids per item, in arrival order
+        deque<int> ready;                                // items with pending bids
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    atomic<size_t> queued{0};
+    Histogram burst_size{"ivory_bid_burst_size", "",
+                         "Bids queued on one item when its worker picked them up", Histogram::Unit::Count};
+
+    Shard &shard_for(int item_id)
+    {
+        return *shards[static_cast<unsigned>(item_id) % shards.size()];
+    }
+
+    void worker(Shard &shard)
+    {
+        while (true)
+        {
+            int item_id;
+            vector<PendingBid> bids;
+            {
+                unique_lock<mutex> lock(shard.mtx);
+                shard.cv.wait(lock, [&shard] { return !shard.ready.empty(); });
+                item_id = shard.ready.front();
+                shard.ready.pop_front();
+
+                auto it = shard.pending.find(item_id);
+                bids = move(it->second);
+                shard.pending.erase(it);
+            }
+
+            queued.fetch_sub(bids.size(), memory_order_relaxed);
+            burst_size.record(bids.size());
+            process_bids(item_id, bids);
+        }
+    }
+
+public:
+    void start(size_t workers)
+    {
+        for (size_t i = 0; i < workers; i++)
+        {
+            shards.push_back(make_unique<Shard>());
+        }
+        for (auto &shard : shards)
+        {
+            thread(&BidEngine::worker, this, ref(*shard)).detach();
+        }
+    }
+
+    void submit(int item_id, int user_id, double amount, weak_ptr<ix::WebSocket> ws)
+    {
+        Shard &shard = shard_for(item_id);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            auto &bids = shard.pending[item_id];
+            if (bids.empty())
+            {
+                shard.ready.push_back(item_id);
+            }
+            bids.push_back({user_id, amount, move(ws), chrono::steady_clock::now()});
+        }
+        queued.fetch_add(1, memory_order_relaxed);
+        shard.cv.notify_one();
+    }
+
+    size_t depth() const { return queued.load(memory_order_relaxed); }
+};
+
+BidEngine bid_engine;
+
+vector<pair<Item, int>> get_cart_items(int user_id)
+{
+    vector<pair<Item, int>> cart_items;
+    
+    auto conn = read_pool.acquire();
+    auto stmt = conn->statement(Stmt::GetCartItems);
+    sqlite3_bind_int(stmt, 1, user_id);
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Item item;
+        item.id = sqlite3_column_int(stmt, 0);
+        item.name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        
+        if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+            item.description = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+        }
+        
+        item.listing_type = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+        item.current_bid = sqlite3_column_double(stmt, 4);
+        item.fixed_price = sqlite3_column_double(stmt, 5);
+        item.inventory = sqlite3_column_int(stmt, 6);
+        item.bidder_id = sqlite3_column_int(stmt, 7);
+        item.end_time = sqlite3_column_int64(stmt, 8);
+        item.version = sqlite3_column_int(stmt, 9);
+        
+        int quantity = sqlite3_column_int(stmt, 10);
+        cart_items.emplace_back(item, quantity);
+    }
+    
+    return cart_items;
+}
+
+// --------------------------
+// Cart Store
+// --------------------------
+// Carts live in memory and are the authority for GET_CART, ADD_TO_CART and
+// UPDATE_CART, so none of them touch SQLite. A user's cart is loaded once, at
+// login. Changes are coalesced per (user, item) and written back by a
+// flusher thread, one transaction per flush_interval. Once a user's last
+// session expires and their changes have been written, the cart is dropped.
+class CartStore
+{
+private:
+    static constexpr size_t shard_count = 16;
+
+    struct Shard
+    {
+        mutex mtx;
+        unordered_map<int, Cart> carts;
+    };
+
+    array<Shard, shard_count> shards;
+
+    mutex pending_mtx;
+    condition_variable cv;
+    map<pair<int, int>, int> pending;  // (user_id, item_id) -> quantity; 0 deletes
+    unordered_set<int> in_flight;      // Users with lines in the batch being written
+    unordered_set<int> unloading;      // Users to drop once their lines are written
+    chrono::milliseconds flush_interval{50};
+    Histogram transaction_time = db_transaction_histogram("cart");
+
+    Shard &shard_for(int user_id)
+    {
+        return shards[static_cast<unsigned>(user_id) % shard_count];
+    }
+
+    static void recompute(Cart &cart)
+    {
+        cart.total = 0.0;
+        for (const auto &line : cart.lines)
+            cart.total += line.price * line.quantity;
+    }
+
+    // Called under the cart's shard lock so writes queue in the order they
+    // were applied
+    void record(int user_id, int item_id, int quantity)
+    {
+        bool wake;
+        {
+            lock_guard<mutex> lock(pending_mtx);
+            wake = pending.empty();
+            pending[{user_id, item_id}] = quantity;
+        }
+        if (wake)
+            cv.notify_one();
+    }
+
+    bool write_batch(const map<pair<int, int>, int> &batch)
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        ScopedTimer timer(transaction_time);
+        if (!db.exec(Stmt::Begin))
+            return false;
+
+        for (const auto &[key, quantity] : batch)
+        {
+            auto stmt = db.statement(quantity > 0 ? Stmt::SetCartQuantity : Stmt::DeleteCartItem);
+            sqlite3_bind_int(stmt, 1, key.first);
+            sqlite3_bind_int(stmt, 2, key.second);
+            if (quantity > 0)
+                sqlite3_bind_int(stmt, 3, quantity);
+            if (sqlite3_step(stmt) != SQLITE_DONE)
+            {
+                db.exec(Stmt::Rollback);
+                return false;
+            }
+        }
+
+        if (db.exec(Stmt::Commit))
+            return true;
+        db.exec(Stmt::Rollback);  // Don't leave the writer inside a transaction
+        return false;
+    }
+
+    void flusher()
+    {
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(pending_mtx);
+                cv.wait(lock, [this] { return !pending.empty(); });
+            }
+            this_thread::sleep_for(flush_interval);  // Let the batch fill up
+
+            map<pair<int, int>, int> batch;
+            {
+                lock_guard<mutex> lock(pending_mtx);
+                batch.swap(pending);
+                for (const auto &[key, quantity] : batch)
+                    in_flight.insert(key.first);
+            }
+
+            bool written = write_batch(batch);
+            if (!written)
+                LOG_LIMITED(Error, 1, "Cart flush failed: ", sqlite3_errmsg(db.handle));
+
+            vector<int> ready;
+            {
+                lock_guard<mutex> lock(pending_mtx);
+                // Requeue, keeping any newer change to the same line
+                if (!written)
+                    pending.insert(batch.begin(), batch.end());
+                in_flight.clear();
+                for (auto it = unloading.begin(); it != unloading.end();)
+                {
+                    if (has_pending(*it))
+                    {
+                        ++it;
+                        continue;
+                    }
+                    ready.push_back(*it);
+                    it = unloading.erase(it);
+                }
+            }
+            for (int user_id : ready)
+                unload(user_id);
+        }
+    }
+
+    // Requires pending_mtx
+    bool has_pending(int user_id) const
+    {
+        if (in_flight.count(user_id))
+            return true;
+        auto it = pending.lower_bound({user_id, INT_MIN});
+        return it != pending.end() && it->first.first == user_id;
+    }
+
+public:
+    void start(chrono::milliseconds interval)
+    {
+        flush_interval = interval;
+        thread(&CartStore::flusher, this).detach();
+    }
+
+    // Reads the user's saved cart unless it is already in memory
+    void load(int user_id)
+    {
+        Shard &shard = shard_for(user_id);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            if (shard.carts.count(user_id))
+                return;
+        }
+
+        Cart cart;
+        for (const auto &[item, quantity] : get_cart_items(user_id))
+        {
+            // Best effort: lines that can't be held now are claimed at checkout
+            inventory.hold(user_id, item.id, quantity);
+            cart.lines.push_back({item.id, quantity, item.fixed_price, item.name});
+        }
+        recompute(cart);
+
+        lock_guard<mutex> lock(shard.mtx);
+        shard.carts.emplace(user_id, move(cart));  // A concurrent login may have won
+    }
+
+    Cart get(int user_id)
+    {
+        Shard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.carts.find(user_id);
+        return it != shard.carts.end() ? it->second : Cart{};
+    }
+
+    bool add(int user_id, int item_id, int quantity)
+    {
+        if (quantity <= 0)
+            return false;
+
+        double price;
+        string name;
+        {
+            auto lock = items_monitor.get_lock();
+            auto it = items.find(item_id);
+            // Only fixed-price items can be added to cart
+            if (it == items.end() || it->second.listing_type != "fixed")
+                return false;
+            price = it->second.fixed_price;
+            name = it->second.name;
+        }
+
+        Shard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        Cart &cart = shard.carts[user_id];
+        auto line = find_if(cart.lines.begin(), cart.lines.end(),
+                            [item_id](const CartItem &l) { return l.item_id == item_id; });
+        int total = (line == cart.lines.end() ? 0 : line->quantity) + quantity;
+        if (!inventory.hold(user_id, item_id, total))
+            return false;
+
+        if (line == cart.lines.end())
+        {
+            cart.lines.push_back({item_id, quantity, price, move(name)});
+            line = prev(cart.lines.end());
+        }
+        else
+        {
+            line->quantity = total;
+            line->price = price;
+        }
+        recompute(cart);
+        record(user_id, item_id, line->quantity);
+        return true;
+    }
+
+    // Sets a line's quantity, removing it at zero or below. Fails if the
+    // extra units can't be held.
+    bool update(int user_id, int item_id, int quantity)
+    {
+        Shard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        Cart &cart = shard.carts[user_id];
+        auto line = find_if(cart.lines.begin(), cart.lines.end(),
+                            [item_id](const CartItem &l) { return l.item_id == item_id; });
+        if (line == cart.lines.end())
+            return true;
+        if (!inventory.hold(user_id, item_id, max(quantity, 0)))
+            return false;
+
+        if (quantity <= 0)
+            cart.lines.erase(line);
+        else
+            line->quantity = quantity;
+        recompute(cart);
+        record(user_id, item_id, max(quantity, 0));
+        return true;
+    }
+
+    // Drops the cart of a user with no sessions left, releasing its holds.
+    // Deferred while any of its changes are still waiting to be written, so
+    // a later login reads them back from SQLite.
+    void unload(int user_id)
+    {
+        Shard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.carts.find(user_id);
+        if (it == shard.carts.end() || sessions.has_user(user_id))
+            return;
+        {
+            lock_guard<mutex> pending_lock(pending_mtx);
+            if (has_pending(user_id))
+            {
+                unloading.insert(user_id);
+                return;
+            }
+        }
+
+        for (const auto &line : it->second.lines)
+            inventory.hold(user_id, line.item_id, 0);
+        shard.carts.erase(it);
+    }
+
+    size_t loaded()
+    {
+        size_t count = 0;
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            count += shard.carts.size();
+        }
+        return count;
+    }
+
+    void clear(int user_id)
+    {
+        Shard &shard = shard_for(user_id);
+        lock_guard<mutex> lock(shard.mtx);
+        Cart &cart = shard.carts[user_id];
+        for (const auto &line : cart.lines)
+        {
+            inventory.hold(user_id, line.item_id, 0);
+            record(user_id, line.item_id, 0);
+        }
+        cart = Cart{};
+    }
+};
+
+CartStore carts;
+
+// The cart's lines priced from the live catalog, ready for create_order
+vector<pair<Item, int>> cart_order_items(const Cart &cart)
+{
+    vector<pair<Item, int>> order_items;
+    auto lock = items_monitor.get_lock();
+    for (const auto &line : cart.lines)
+    {
+        if (auto it = items.find(line.item_id); it != items.end())
+            order_items.emplace_back(it->second, line.quantity);
+    }
+    return order_items;
+}
+
+// CART_ITEMS in the connection's encoding
+string cart_message(const Cart &cart, bool binary)
+{
+    if (binary)
+    {
+        string out = wire_header(WireType::CartItems);
+        put_le(out, static_cast<uint32_t>(cart.lines.size()));
+        for (const auto &line : cart.lines)
+        {
+            put_le(out, static_cast<int32_t>(line.item_id));
+            put_le(out, static_cast<int32_t>(line.quantity));
+            put_le(out, line.price);
+            put_str(out, line.name);
+        }
+        put_le(out, cart.total);
+        return out;
+    }
+
+    stringstream response;
+    response << "CART_ITEMS";
+    for (const auto &line : cart.lines)
+    {
+        response << "|" << line.item_id << "," 
+                 << line.name << ","
+                 << line.price << ","
+                 << line.quantity;
+    }
+    response << "|TOTAL," << cart.total;
+    return response.str();
+}
+
+// Pushes the current cart to every device the user is logged in on
+void send_cart_update_to_user(int user_id)
+{
+    auto connections = sessions.connections(user_id);
+    if (connections.empty())
+        return;
+
+    Cart cart = carts.get(user_id);
+    string encoded[2];  // text, binary; built on first use
+    for (const auto &conn : connections)
+    {
+        auto ws_ptr = conn->ws.lock();
+        if (!ws_ptr)
+            continue;
+        bool binary = conn->binary;
+        if (encoded[binary].empty())
+            encoded[binary] = cart_message(cart, binary);
+        send_frame(*ws_ptr, encoded[binary], binary);
+    }
+}
+
+
+bool add_item(const string &name, const string &description, const string &listing_type, 
+             double price, int inventory, int64_t end_time = 0)
+{
+    Item item;
+    item.name = name;
+    item.description = description;
+    item.listing_type = listing_type;
+    item.inventory = inventory;
+    item.end_time = end_time;
+
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        auto stmt = db.statement(Stmt::InsertItem);
+
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, description.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, listing_type.c_str(), -1, SQLITE_STATIC);
+        
+        if (listing_type == "auction") {
+            sqlite3_bind_double(stmt, 4, price);  // starting bid
+            sqlite3_bind_double(stmt, 5, 0.0);    // fixed price (0 for auctions)
+        } else {
+            sqlite3_bind_double(stmt, 4, 0.0);    // current bid (0 for fixed)
+            sqlite3_bind_double(stmt, 5, price);  // fixed price
+        }
+        
+        sqlite3_bind_int(stmt, 6, inventory);
+        sqlite3_bind_int64(stmt, 7, end_time);
+        
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
+        }
+        item.id = sqlite3_last_insert_rowid(db.handle);
+    }
+
+    if (listing_type == "auction") {
+        item.current_bid = price;
+    } else {
+        item.fixed_price = price;
+    }
+    on_item_added(move(item));
+    return true;
+}
+
+// --------------------------
+// Order History
+// --------------------------
+struct OrderLine
+{
+    int item_id;
+    int quantity;
+    double price;
+};
+
+struct OrderSummary
+{
+    int id;
+    double total;
+    string status;
+    vector<OrderLine> lines;
+};
+
+// GET_ORDERS pages through a user's orders newest first, keyed on order id
+// (orders(user_id, id) is indexed). Each user's most recent `depth` orders
+// are cached the first time they are asked for, then kept current as orders
+// are created and paid, so the common "latest orders" request never reads
+// SQLite. Pages reaching further back fall through to a keyset query. At
+// most max_users users stay cached, least recently used first out, and a
+// user is dropped as soon as their last session expires.
+class OrderHistory
+{
+public:
+    struct Page
+    {
+        vector<OrderSummary> orders;
+        int next_cursor = 0;  // `before` for the next page; 0 when there is none
+    };
+
+    static constexpr size_t default_limit = 20;
+    static constexpr size_t max_limit = 100;
+
+private:
+    struct UserOrders
+    {
+        map<int, OrderSummary, greater<int>> recent;
+        bool has_older = false;  // SQLite holds orders older than `recent`
+        list<int>::iterator lru;
+    };
+
+    // A first page being read from SQLite; any change meanwhile spoils it
+    struct Load
+    {
+        int readers = 0;
+        bool changed = false;
+    };
+
+    mutex mtx;
+    unordered_map<int, UserOrders> users;
+    list<int> lru;  // Cached users, most recently used first
+    unordered_map<int, Load> loads;
+    size_t depth = 50;
+    size_t max_users = 10000;
+
+    // Requires mtx
+    void touch(UserOrders &cached)
+    {
+        lru.splice(lru.begin(), lru, cached.lru);
+    }
+
+    // Requires mtx
+    void changed(int user_id)
+    {
+        if (auto load = loads.find(user_id); load != loads.end())
+            load->second.changed = true;
+    }
+
+    // Up to limit orders older than before, newest first
+    static vector<OrderSummary> query(int user_id, int before, size_t limit)
+    {
+        vector<OrderSummary> orders;
+        auto conn = read_pool.acquire();
+        auto stmt = conn->statement(Stmt::GetOrdersPage);
+        sqlite3_bind_int(stmt, 1, user_id);
+        sqlite3_bind_int(stmt, 2, before);
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(limit));
+
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            int order_id = sqlite3_column_int(stmt, 0);
+            if (orders.empty() || orders.back().id != order_id)
+            {
+                orders.push_back({order_id, sqlite3_column_double(stmt, 1),
+                                  reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)), {}});
+            }
+            orders.back().lines.push_back({sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4),
+                                           sqlite3_column_double(stmt, 5)});
+            LOG(Debug, "Order row for user ", user_id, ": order ", order_id, " item ",
+                orders.back().lines.back().item_id, " x", orders.back().lines.back().quantity);
+        }
+        return orders;
+    }
+
+    // Trims a page fetched with one extra row
+    static Page finish(vector<OrderSummary> orders, size_t limit, bool more)
+    {
+        Page page;
+        if (orders.size() > limit)
+        {
+            orders.resize(limit);
+            more = true;
+        }
+        if (more && !orders.empty())
+            page.next_cursor = orders.back().id;
+        page.orders = move(orders);
+        return page;
+    }
+
+public:
+    Page page(int user_id, int before, size_t limit)
+    {
+        if (before <= 0)
+            before = INT_MAX;
+        limit = clamp<size_t>(limit ? limit : default_limit, 1, max_limit);
+
+        bool first_load = before == INT_MAX;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (auto it = users.find(user_id); it != users.end())
+            {
+                UserOrders &cached = it->second;
+                touch(cached);
+                vector<OrderSummary> orders;
+                for (auto o = cached.recent.upper_bound(before); o != cached.recent.end() && orders.size() <= limit; ++o)
+                    orders.push_back(o->second);
+                if (orders.size() > limit || !cached.has_older)
+                    return finish(move(orders), limit, false);
+            }
+            if (first_load)
+                loads[user_id].readers++;
+        }
+
+        size_t fetch = first_load ? max(limit, depth) + 1 : limit + 1;
+        auto orders = query(user_id, before, fetch);
+
+        if (first_load)
+        {
+            lock_guard<mutex> lock(mtx);
+            Load &load = loads[user_id];
+            // Only cache if no order changed while we were reading
+            if (!load.changed && !users.count(user_id))
+            {
+                UserOrders &cached = users[user_id];
+                cached.has_older = orders.size() > depth;
+                for (size_t i = 0; i < orders.size() && i < depth; i++)
+                    cached.recent.emplace(orders[i].id, orders[i]);
+                lru.push_front(user_id);
+                cached.lru = lru.begin();
+                if (users.size() > max_users)
+                {
+                    users.erase(lru.back());
+                    lru.pop_back();
+                }
+            }
+            if (--load.readers == 0)
+                loads.erase(user_id);
+        }
+
+        bool more = orders.size() > limit;
+        orders.resize(min(orders.size(), limit));
+        return finish(move(orders), limit, more);
+    }
+
+    void on_created(int user_id, OrderSummary order)
+    {
+        lock_guard<mutex> lock(mtx);
+        changed(user_id);
+        auto it = users.find(user_id);
+        if (it == users.end())
+            return;
+        UserOrders &cached = it->second;
+        touch(cached);
+        cached.recent.emplace(order.id, move(order));
+        if (cached.recent.size() > depth)
+        {
+            cached.recent.erase(prev(cached.recent.end()));
+            cached.has_older = true;
+        }
+    }
+
+    void on_paid(int user_id, int order_id)
+    {
+        lock_guard<mutex> lock(mtx);
+        changed(user_id);
+        if (auto it = users.find(user_id); it != users.end())
+        {
+            if (auto order = it->second.recent.find(order_id); order != it->second.recent.end())
+                order->second.status = "paid";
+        }
+    }
+
+    // Drops a user's cached orders, e.g. once they have no session left
+    void forget(int user_id)
+    {
+        lock_guard<mutex> lock(mtx);
+        changed(user_id);
+        if (auto it = users.find(user_id); it != users.end())
+        {
+            lru.erase(it->second.lru);
+            users.erase(it);
+        }
+    }
+};
+
+OrderHistory order_history;
+
+// --------------------------
+// Checkout Pipeline
+// --------------------------
+// Concurrent checkouts are gathered over a short window and committed
+// together. Each order's units are claimed through the inventory engine, then
+// every accepted order with its items, inventory decrements and cart clear
+// goes into one transaction. Each order is written under its
+// own savepoint, so an order that would oversell fails alone while the rest
+// of the batch commits.
+class CheckoutPipeline
+{
+private:
+    struct Request
+    {
+        int user_id;
+        vector<pair<Item, int>> items;
+        bool from_cart;
+        promise<int> order_id;
+    };
+
+    mutex mtx;
+    condition_variable cv;
+    vector<Request> pending;
+    chrono::milliseconds window{2};
+    size_t max_batch = 256;
+    Histogram transaction_time = db_transaction_histogram("checkout");
+
+    static double unit_price(const Item &item)
+    {
+        return item.listing_type == "fixed" ? item.fixed_price : item.current_bid;
+    }
+
+    using Holds = vector<pair<int, int>>;  // (item_id, units held before the order)
+
+    // Claims every order's units through inventory holds, in arrival order.
+    // A cart order holds what its cart lines promise; any other order adds
+    // its units on top of whatever the user already holds. An order whose
+    // units can't all be held is rejected on its own. previous records the
+    // holds each order replaced, so a failed order can put them back.
+    vector<bool> validate(const vector<Request> &batch, vector<Holds> &previous)
+    {
+        vector<bool> accepted(batch.size(), false);
+        previous.assign(batch.size(), {});
+        map<pair<int, int>, int> claimed;  // (user_id, item_id) -> units promised so far
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            int user_id = batch[i].user_id;
+            map<int, int> wanted;
+            bool ok = true;
+            for (const auto &[item, quantity] : batch[i].items)
+            {
+                if (quantity <= 0)
+                    ok = false;
+                // Auctions are closed to bids before their order is placed
+                if (item.listing_type == "fixed")
+                    wanted[item.id] += quantity;
+            }
+
+            for (auto it = wanted.begin(); ok && it != wanted.end(); ++it)
+            {
+                int before = 0;
+                if (batch[i].from_cart)
+                    ok = inventory.hold(user_id, it->first, claimed[{user_id, it->first}] + it->second,
+                                        false, &before);
+                else
+                    ok = inventory.hold(user_id, it->first, it->second, true, &before);
+                if (ok)
+                    previous[i].emplace_back(it->first, before);
+            }
+
+            if (!ok)
+            {
+                release(user_id, previous[i]);
+                continue;
+            }
+            for (const auto &[item_id, quantity] : wanted)
+                claimed[{user_id, item_id}] += quantity;
+            accepted[i] = true;
+        }
+        return accepted;
+    }
+
+    static void release(int user_id, const Holds &previous)
+    {
+        for (const auto &[item_id, quantity] : previous)
+            inventory.hold(user_id, item_id, quantity);
+    }
+
+    static double order_total(const vector<pair<Item, int>> &items)
+    {
+        double total = 0.0;
+        for (const auto &[item, quantity] : items)
+        {
+            total += (item.listing_type == "fixed") ? item.fixed_price * quantity : item.current_bid;
+        }
+        return total;
+    }
+
+    // Requires db_mutex and an open transaction
+    int write_order(const Request &request)
+    {
+        double total = order_total(request.items);
+
+        {
+            auto order_stmt = db.statement(Stmt::InsertOrder);
+            sqlite3_bind_int(order_stmt, 1, request.user_id);
+            sqlite3_bind_double(order_stmt, 2, total);
+            if (sqlite3_step(order_stmt) != SQLITE_DONE)
+                return -1;
+        }
+        int order_id = sqlite3_last_insert_rowid(db.handle);
+
+        for (const auto &[item, quantity] : request.items)
+        {
+            auto item_stmt = db.statement(Stmt::InsertOrderItem);
+            sqlite3_bind_int(item_stmt, 1, order_id);
+            sqlite3_bind_int(item_stmt, 2, item.id);
+            sqlite3_bind_int(item_stmt, 3, quantity);
+            sqlite3_bind_double(item_stmt, 4, unit_price(item));
+            sqlite3_bind_int(item_stmt, 5, (item.listing_type == "auction") ? 1 : 0);
+            if (sqlite3_step(item_stmt) != SQLITE_DONE)
+                return -1;
+
+            if (item.listing_type == "fixed")
+            {
+                auto update_stmt = db.statement(Stmt::DecrementInventory);
+                sqlite3_bind_int(update_stmt, 1, quantity);
+                sqlite3_bind_int(update_stmt, 2, item.id);
+                sqlite3_bind_int(update_stmt, 3, quantity);
+                // No row changed means SQLite has less stock than we thought
+                if (sqlite3_step(update_stmt) != SQLITE_DONE || sqlite3_changes(db.handle) != 1)
+                    return -1;
+            }
+        }
+
+        if (request.from_cart)
+        {
+            auto clear_stmt = db.statement(Stmt::ClearCart);
+            sqlite3_bind_int(clear_stmt, 1, request.user_id);
+            if (sqlite3_step(clear_stmt) != SQLITE_DONE)
+                return -1;
+        }
+
+        return order_id;
+    }
+
+    void commit(vector<Request> &batch)
+    {
+        vector<Holds> previous;
+        vector<bool> accepted = validate(batch, previous);
+        vector<int> order_ids(batch.size(), -1);
+        bool committed = false;
+
+        {
+            lock_guard<mutex> db_lock(db_mutex);
+            ScopedTimer timer(transaction_time);
+            if (db.exec(Stmt::Begin))
+            {
+                for (size_t i = 0; i < batch.size(); i++)
+                {
+                    if (!accepted[i] || !db.exec(Stmt::Savepoint))
+                        continue;
+                    order_ids[i] = write_order(batch[i]);
+                    if (order_ids[i] <= 0)
+                    {
+                        order_ids[i] = -1;
+                        db.exec(Stmt::RollbackToSavepoint);
+                    }
+                    db.exec(Stmt::ReleaseSavepoint);
+                }
+
+                committed = db.exec(Stmt::Commit);
+                if (!committed)
+                    db.exec(Stmt::Rollback);
+            }
+        }
+
+        if (!committed)
+        {
+            LOG_LIMITED(Error, 5, "Checkout batch of ", batch.size(), " failed: ", sqlite3_errmsg(db.handle));
+            fill(order_ids.begin(), order_ids.end(), -1);
+        }
+
+        // Newest first, so a user's earlier order in the batch restores last
+        for (size_t i = batch.size(); i-- > 0;)
+        {
+            if (accepted[i] && order_ids[i] <= 0)
+                release(batch[i].user_id, previous[i]);
+        }
+
+        // One stock update per item for the whole batch
+        map<int, pair<Item, int>> sold;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (order_ids[i] <= 0)
+                continue;
+            for (const auto &[item, quantity] : batch[i].items)
+            {
+                auto [it, inserted] = sold.try_emplace(item.id, item, 0);
+                it->second.second += quantity;
+                if (item.listing_type == "fixed")
+                    inventory.sell(batch[i].user_id, item.id, quantity);
+            }
+            if (batch[i].from_cart)
+                carts.clear(batch[i].user_id);
+
+            OrderSummary summary{order_ids[i], order_total(batch[i].items), "pending", {}};
+            for (const auto &[item, quantity] : batch[i].items)
+                summary.lines.push_back({item.id, quantity, unit_price(item)});
+            order_history.on_created(batch[i].user_id, move(summary));
+        }
+        vector<pair<Item, int>> sold_items;
+        for (auto &[item_id, entry] : sold)
+            sold_items.push_back(move(entry));
+        on_items_sold(sold_items);
+
+        for (size_t i = 0; i < batch.size(); i++)
+            batch[i].order_id.set_value(order_ids[i]);
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            vector<Request> batch;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [this] { return !pending.empty(); });
+                cv.wait_for(lock, window, [this] { return pending.size() >= max_batch; });
+                batch.swap(pending);
+            }
+            commit(batch);
+        }
+    }
+
+public:
+    void start(chrono::milliseconds batch_window, size_t batch_size)
+    {
+        window = batch_window;
+        max_batch = batch_size;
+        thread(&CheckoutPipeline::run, this).detach();
+    }
+
+    future<int> submit(int user_id, vector<pair<Item, int>> items, bool from_cart)
+    {
+        Request request{user_id, move(items), from_cart, {}};
+        auto result = request.order_id.get_future();
+        bool wake;
+        {
+            lock_guard<mutex> lock(mtx);
+            pending.push_back(move(request));
+            wake = pending.size() == 1 || pending.size() >= max_batch;
+        }
+        if (wake)
+            cv.notify_one();
+        return result;
+    }
+
+    size_t depth()
+    {
+        lock_guard<mutex> lock(mtx);
+        return pending.size();
+    }
+};
+
+CheckoutPipeline checkout_pipeline;
+
+// Blocks until the batch holding this order has committed; -1 on failure
+int create_order(int user_id, const vector<pair<Item, int>> &items, bool from_cart)
+{
+    return checkout_pipeline.submit(user_id, items, from_cart).get();
+}
+
+
+// --------------------------
+// Payments
+// --------------------------
+struct PaymentRequest
+{
+    int order_id;
+    int user_id;
+    string method;
+    string idempotency_key;
+    double amount;
+};
+
+struct ChargeResult
+{
+    bool approved;
+    string transaction_id;
+    string reason;  // Why a charge was declined
+};
+
+// Whatever actually moves the money. Called from payment workers with no
+// locks held, so an implementation may block for as long as its network
+// round trip takes. A charge must be idempotent on request.idempotency_key,
+// as real processors' are: a payment whose outcome was never recorded is
+// charged again under the same key once its claim goes stale.
+class PaymentGateway
+{
+public:
+    virtual ~PaymentGateway() = default;
+    virtual ChargeResult charge(const PaymentRequest &request) = 0;
+};
+
+// Local stand-in for a real processor: waits out a fixed latency and
+// declines a configurable share of charges
+class LocalGateway : public PaymentGateway
+{
+private:
+    chrono::milliseconds latency;
+    unsigned decline_percent;
+
+public:
+    LocalGateway(chrono::milliseconds delay, unsigned declines) : latency(delay), decline_percent(declines) {}
+
+    ChargeResult charge(const PaymentRequest &) override
+    {
+        thread_local mt19937_64 rng(random_device{}());
+        this_thread::sleep_for(latency);
+        if (rng() % 100 < decline_percent)
+            return {false, "", "Card declined"};
+
+        char suffix[17];
+        snprintf(suffix, sizeof(suffix), "%016llx", static_cast<unsigned long long>(rng()));
+        return {true, "TX" + to_string(time(nullptr)) + "_" + suffix, ""};
+    }
+};
+
+// Payments run on their own worker pool, off the WebSocket threads. Every
+// payment is keyed by an idempotency key with a unique row in the payments
+// table: a repeated request for a completed payment gets the original
+// result back, one still in flight is refused, and a declined one may be
+// retried. A key only ever pays for the order it was first used on, and an
+// order has at most one pending or completed payment. A pending payment
+// whose outcome could not be recorded is reclaimed by the next request with
+// its key once stale_after has passed. db_mutex is only held for the short
+// bookkeeping transactions on either side of the gateway call, never
+// across it.
+class PaymentProcessor
+{
+public:
+    // (paid, transaction id or reason for failure)
+    using Callback = function<void(bool, const string &)>;
+
+private:
+    struct Job
+    {
+        PaymentRequest request;
+        Callback done;
+    };
+
+    mutex mtx;
+    condition_variable cv;
+    deque<Job> queue;
+    unique_ptr<PaymentGateway> gateway;
+    Histogram transaction_time = db_transaction_histogram("payment");
+    Histogram charge_time{"ivory_payment_gateway_seconds", "", "Time spent waiting on the payment gateway"};
+    chrono::seconds stale_after{300};
+    int max_finish_attempts = 5;
+
+    // Blocked by idx_payments_order_active: the order already has a live payment
+    static bool order_has_active_payment()
+    {
+        return sqlite3_extended_errcode(db.handle) == SQLITE_CONSTRAINT_UNIQUE;
+    }
+
+    // Claims the idempotency key for a new or retried charge. Otherwise
+    // answers the job itself and returns false.
+    bool begin_payment(Job &job)
+    {
+        PaymentRequest &request = job.request;
+        string refusal;
+        bool replay = false;
+        string transaction_id;
+
+        {
+            lock_guard<mutex> db_lock(db_mutex);
+            ScopedTimer timer(transaction_time);
+            if (!db.exec(Stmt::Begin))
+            {
+                refusal = "Payment processing failed";
+            }
+            else
+            {
+                int64_t now = time(nullptr);
+                int64_t stale = now - stale_after.count();
+
+                auto order_stmt = db.statement(Stmt::GetOrderTotal);
+                sqlite3_bind_int(order_stmt, 1, request.order_id);
+                sqlite3_bind_int(order_stmt, 2, request.user_id);
+                bool found = sqlite3_step(order_stmt) == SQLITE_ROW;
+                bool paid = found &&
+                            string(reinterpret_cast<const char *>(sqlite3_column_text(order_stmt, 1))) == "paid";
+                if (found)
+                    request.amount = sqlite3_column_double(order_stmt, 0);
+
+                auto find_stmt = db.statement(Stmt::FindPayment);
+                sqlite3_bind_text(find_stmt, 1, request.idempotency_key.c_str(), -1, SQLITE_STATIC);
+                if (!found)
+                {
+                    refusal = "Order not found";
+                }
+                else if (sqlite3_step(find_stmt) == SQLITE_ROW)
+                {
+                    string status = reinterpret_cast<const char *>(sqlite3_column_text(find_stmt, 0));
+                    if (sqlite3_column_int(find_stmt, 2) != request.order_id)
+                    {
+                        refusal = "Idempotency key already used for another order";
+                    }
+                    else if (status == "completed")
+                    {
+                        replay = true;
+                        if (sqlite3_column_type(find_stmt, 1) != SQLITE_NULL)
+                            transaction_id = reinterpret_cast<const char *>(sqlite3_column_text(find_stmt, 1));
+                    }
+                    else if (status == "pending" && sqlite3_column_int64(find_stmt, 3) >= stale)
+                    {
+                        refusal = "Payment already in progress";
+                    }
+                    else if (paid)
+                    {
+                        refusal = "Order already paid";
+                    }
+                    else
+                    {
+                        // Declined, or pending with an outcome nobody recorded
+                        auto retry_stmt = db.statement(Stmt::RetryPayment);
+                        sqlite3_bind_text(retry_stmt, 1, request.method.c_str(), -1, SQLITE_STATIC);
+                        sqlite3_bind_double(retry_stmt, 2, request.amount);
+                        sqlite3_bind_int64(retry_stmt, 3, now);
+                        sqlite3_bind_text(retry_stmt, 4, request.idempotency_key.c_str(), -1, SQLITE_STATIC);
+                        sqlite3_bind_int64(retry_stmt, 5, stale);
+                        if (sqlite3_step(retry_stmt) != SQLITE_DONE)
+                            refusal = order_has_active_payment() ? "Payment already in progress"
+                                                                 : "Payment processing failed";
+                        else if (sqlite3_changes(db.handle) == 0)
+                            refusal = "Payment already in progress";
+                    }
+                }
+                else if (paid)
+                {
+                    refusal = "Order already paid";
+                }
+                else
+                {
+                    auto insert_stmt = db.statement(Stmt::InsertPayment);
+                    sqlite3_bind_int(insert_stmt, 1, request.order_id);
+                    sqlite3_bind_double(insert_stmt, 2, request.amount);
+                    sqlite3_bind_text(insert_stmt, 3, request.method.c_str(), -1, SQLITE_STATIC);
+                    sqlite3_bind_text(insert_stmt, 4, request.idempotency_key.c_str(), -1, SQLITE_STATIC);
+                    sqlite3_bind_int64(insert_stmt, 5, now);
+                    if (sqlite3_step(insert_stmt) != SQLITE_DONE)
+                        refusal = order_has_active_payment() ? "Payment already in progress"
+                                                             : "Payment processing failed";
+                }
+
+                if (!refusal.empty() || replay)
+                {
+                    db.exec(Stmt::Rollback);
+                }
+                else if (!db.exec(Stmt::Commit))
+                {
+                    refusal = "Payment processing failed";
+                    db.exec(Stmt::Rollback);
+                }
+            }
+        }
+
+        if (replay)
+            job.done(true, transaction_id);
+        else if (!refusal.empty())
+            job.done(false, refusal);
+        return refusal.empty() && !replay;
+    }
+
+    bool finish_payment(const PaymentRequest &request, const ChargeResult &result)
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        ScopedTimer timer(transaction_time);
+        if (!db.exec(Stmt::Begin))
+            return false;
+
+        {
+            auto finish_stmt = db.statement(Stmt::FinishPayment);
+            sqlite3_bind_text(finish_stmt, 1, result.approved ? "completed" : "failed", -1, SQLITE_STATIC);
+            if (result.approved)
+                sqlite3_bind_text(finish_stmt, 2, result.transaction_id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(finish_stmt, 3, request.idempotency_key.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(finish_stmt) != SQLITE_DONE)
+            {
+                db.exec(Stmt::Rollback);
+                return false;
+            }
+        }
+
+        if (result.approved)
+        {
+            auto update_stmt = db.statement(Stmt::MarkOrderPaid);
+            sqlite3_bind_int(update_stmt, 1, request.order_id);
+            if (sqlite3_step(update_stmt) != SQLITE_DONE)
+            {
+                db.exec(Stmt::Rollback);
+                return false;
+            }
+        }
+
+        if (db.exec(Stmt::Commit))
+            return true;
+        db.exec(Stmt::Rollback);  // Don't leave the writer inside a transaction
+        return false;
+    }
+
+    // Makes a payment whose outcome could not be recorded reclaimable by the
+    // next request with its key, instead of after stale_after
+    void release_claim(const PaymentRequest &request)
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        auto release_stmt = db.statement(Stmt::ReleasePaymentClaim);
+        sqlite3_bind_text(release_stmt, 1, request.idempotency_key.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(release_stmt) != SQLITE_DONE)
+            LOG(Error, "Cannot release payment claim ", request.idempotency_key, ": ", sqlite3_errmsg(db.handle));
+    }
+
+    void worker()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [this] { return !queue.empty(); });
+                job = move(queue.front());
+                queue.pop_front();
+            }
+
+            if (!begin_payment(job))
+                continue;
+
+            auto charge_started = chrono::steady_clock::now();
+            ChargeResult result = gateway->charge(job.request);
+            charge_time.record_since(charge_started);
+            bool recorded = false;
+            for (int attempt = 1; !recorded && attempt <= max_finish_attempts; attempt++)
+            {
+                recorded = finish_payment(job.request, result);
+                if (!recorded)
+                {
+                    LOG_LIMITED(Error, 5, "Failed to record payment ", job.request.idempotency_key, ": ",
+                                sqlite3_errmsg(db.handle));
+                    this_thread::sleep_for(chrono::milliseconds(100) * attempt);
+                }
+            }
+            if (!recorded)
+            {
+                // Still pending; a retry with the same key reclaims it (at the
+                // latest after stale_after, if even the release fails)
+                LOG(Error, "Gave up recording payment ", job.request.idempotency_key);
+                release_claim(job.request);
+                job.done(false, "Payment processing failed");
+            }
+            else if (result.approved)
+            {
+                order_history.on_paid(job.request.user_id, job.request.order_id);
+                job.done(true, result.transaction_id);
+            }
+            else
+            {
+                job.done(false, result.reason);
+            }
+        }
+    }
+
+public:
+    void start(unique_ptr<PaymentGateway> payment_gateway, size_t workers, chrono::seconds stale)
+    {
+        gateway = move(payment_gateway);
+        stale_after = stale;
+        for (size_t i = 0; i < workers; i++)
+        {
+            thread(&PaymentProcessor::worker, this).detach();
+        }
+    }
+
+    void submit(int order_id, int user_id, string method, string idempotency_key, Callback done)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            queue.push_back({{order_id, user_id, move(method), move(idempotency_key), 0.0}, move(done)});
+        }
+        cv.notify_one();
+    }
+
+    size_t depth()
+    {
+        lock_guard<mutex> lock(mtx);
+        return queue.size();
+    }
+};
+
+PaymentProcessor payments;
+
+// --------------------------
+// Message Handling
+// --------------------------
+// Splits without allocating; frames with too many fields are rejected
+bool tokenize(string_view msg, char delimiter, Tokens &out)
+{
+    out.count = 0;
+    const char *p = msg.data();
+    const char *end = p + msg.size();
+    while (out.count < Tokens::max_fields)
+    {
+        const char *next = static_cast<const char *>(memchr(p, delimiter, end - p));
+        if (!next)
+        {
+            out.fields[out.count++] = string_view(p, end - p);
+            return true;
+        }
+        out.fields[out.count++] = string_view(p, next - p);
+        p = next + 1;
+    }
+    return false;
+}
+
+// Parses the whole field as a number; no exceptions, no partial matches
+template <typename T>
+bool parse_number(string_view field, T &out)
+{
+    auto [ptr, ec] = from_chars(field.data(), field.data() + field.size(), out);
+    if (ec != errc() || ptr != field.data() + field.size())
+        return false;
+    if constexpr (is_floating_point_v<T>)
+        return isfinite(out);
+    return true;
+}
+
+int session_user_id(string_view session_token)
+{
+    return sessions.resolve(session_token);
+}
+
+void send_cart(int user_id, ix::WebSocket &ws, bool binary)
+{
+    send_frame(ws, cart_message(carts.get(user_id), binary), binary);
+}
+
+// ORDERS_LIST, newest first, for orders older than `before` (0 for the
+// newest). Text pages end with a NEXT,<cursor> entry when more remain; binary
+// pages always end with the i32 cursor, 0 meaning none.
+void send_orders(int user_id, ix::WebSocket &ws, bool binary, int before = 0, size_t limit = 0)
+{
+    auto page = order_history.page(user_id, before, limit);
+
+    if (binary)
+    {
+        string out = wire_header(WireType::OrdersList);
+        put_le(out, static_cast<uint32_t>(page.orders.size()));
+        for (const auto &order : page.orders)
+        {
+            put_le(out, static_cast<int32_t>(order.id));
+            put_le(out, order.total);
+            put_str(out, order.status);
+            put_le(out, static_cast<uint16_t>(min<size_t>(order.lines.size(), UINT16_MAX)));
+            for (size_t i = 0; i < order.lines.size() && i < UINT16_MAX; i++)
+            {
+                put_le(out, static_cast<int32_t>(order.lines[i].item_id));
+                put_le(out, static_cast<int32_t>(order.lines[i].quantity));
+                put_le(out, order.lines[i].price);
+            }
+        }
+        put_le(out, static_cast<int32_t>(page.next_cursor));
+        ws.sendBinary(out);
+        return;
+    }
+
+    stringstream response;
+    response << "ORDERS_LIST";
+
+    for (const auto &order : page.orders)
+    {
+        vector<string> items;
+        for (const auto &line : order.lines)
+            items.push_back(to_string(line.item_id) + ":" + to_string(line.quantity) + ":" + to_string(line.price));
+        response << "|" << order.id << "," << order.total << "," << order.status << "," << join(items, ";");
+    }
+    if (page.next_cursor > 0)
+        response << "|NEXT," << page.next_cursor;
+
+    ws.send(response.str());
+}
+
+using WsPtr = shared_ptr<ix::WebSocket>;
+using ConnPtr = shared_ptr<Connection>;
+
+string start_session(int user_id, const ConnPtr &conn)
+{
+    // Session first: once it exists, CartStore::unload leaves the cart alone
+    string session_token = generate_uuid();
+    sessions.add(session_token, user_id, conn);
+    carts.load(user_id);
+    return session_token;
+}
+
+void handle_login(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    if (parts.size() != 3)
+        return;
+
+    string username(parts[1]);
+    string password(parts[2]);
+
+    int user_id = authenticate_user(username, password);
+    if (user_id != -1)
+    {
+        ws->send("LOGIN_SUCCESS|" + start_session(user_id, conn) + "|" + to_string(user_id));
+    }
+    else
+    {
+        ws->send("ERROR|Invalid credentials");
+    }
+}
+
+Frame items_list(bool binary)
+{
+    auto lock = items_monitor.get_lock();
+    return catalog.items_list(items, binary);
+}
+
+void handle_get_items(const Tokens &, const WsPtr &ws, const ConnPtr &conn)
+{
+    send_frame(*ws, *items_list(conn->binary), conn->binary);
+}
+
+void handle_get_items_since(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    uint64_t since;
+    if (parts.size() != 2 || !parse_number(parts[1], since))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+
+    Frame response;
+    {
+        auto lock = items_monitor.get_lock();
+        response = catalog.changes_since(since, items, conn->binary);
+    }
+    send_frame(*ws, *response, conn->binary);
+}
+
+// Shared by the text BID command and binary Bid frames
+void submit_bid(int item_id, double amount, string_view session_token, const WsPtr &ws)
+{
+    int user_id = session_user_id(session_token);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+
+    {
+        auto lock = items_monitor.get_lock();
+        auto it = items.find(item_id);
+        if (it == items.end())
+        {
+            ws->send("ERROR|Invalid item ID");
+            return;
+        }
+
+        if (it->second.listing_type != "auction")
+        {
+            ws->send("ERROR|Item is not an auction");
+            return;
+        }
+        
+        if ((it->second.end_time > 0 && it->second.end_time < time(nullptr)) ||
+            it->second.inventory <= 0)
+        {
+            ws->send("ERROR|Auction has ended");
+            return;
+        }
+    }
+
+    // Acked by the bid journal once the bid is durable
+    bid_engine.submit(item_id, user_id, amount, ws);
+}
+
+void handle_bid(const Tokens &parts, const WsPtr &ws, const ConnPtr &)
+{
+    if (parts.size() != 4)
+        return;
+
+    int item_id;
+    double amount;
+    if (!parse_number(parts[1], item_id) || !parse_number(parts[2], amount))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+
+    submit_bid(item_id, amount, parts[3], ws);
+}
+
+void handle_add_to_cart(const Tokens &parts, const WsPtr &ws, const ConnPtr &)
+{
+    if (parts.size() != 4)
+        return;
+
+    int item_id, quantity;
+    if (!parse_number(parts[1], item_id) || !parse_number(parts[2], quantity))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+    
+    int user_id = session_user_id(parts[3]);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+    
+    if (carts.add(user_id, item_id, quantity))
+    {
+        send_cart_update_to_user(user_id);
+        ws->send("CART_UPDATED|Item added to cart");
+    }
+    else
+    {
+        ws->send("ERROR|Failed to add item to cart");
+    }
+}
+
+void handle_update_cart(const Tokens &parts, const WsPtr &ws, const ConnPtr &)
+{
+    if (parts.size() != 4)
+        return;
+
+    int item_id, quantity;
+    if (!parse_number(parts[1], item_id) || !parse_number(parts[2], quantity))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+    
+    int user_id = session_user_id(parts[3]);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+    
+    if (carts.update(user_id, item_id, quantity))
+    {
+        send_cart_update_to_user(user_id);
+        ws->send("CART_UPDATED|Cart updated");
+    }
+    else
+    {
+        ws->send("ERROR|Failed to update cart");
+    }
+}
+
+void handle_get_cart(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    if (parts.size() != 2)
+        return;
+
+    int user_id = session_user_id(parts[1]);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+    
+    send_cart(user_id, *ws, conn->binary);
+}
+
+void handle_checkout(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    if (parts.size() != 2)
+        return;
+
+    int user_id = session_user_id(parts[1]);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+    
+    auto cart_items = cart_order_items(carts.get(user_id));
+    if (cart_items.empty())
+    {
+        ws->send("ERROR|Cart is empty");
+        return;
+    }
+    
+    int order_id = create_order(user_id, cart_items);
+    LOG(Debug, "Checkout for user ", user_id, " created order ", order_id);
+    if (order_id > 0)
+    {
+        ws->send("ORDER_CREATED|" + to_string(order_id));
+        send_cart_update_to_user(user_id);
+        send_orders(user_id, *ws, conn->binary);
+    }
+    else
+    {
+        ws->send("ERROR|Failed to create order");
+    }
+}
+
+// PROCESS_PAYMENT|order_id|method|token[|idempotency_key]. Without a key,
+// the order itself is the key, so resending the same request is safe.
+void handle_process_payment(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    if (parts.size() != 4 && parts.size() != 5)
+        return;
+
+    int order_id;
+    if (!parse_number(parts[1], order_id))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+    string payment_method(parts[2]);
+    
+    int user_id = session_user_id(parts[3]);
+    if (user_id == -1)
+    {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+
+    string key = to_string(user_id) + ":" + (parts.size() == 5 ? string(parts[4]) : "order-" + to_string(order_id));
+
+    // Answered from a payment worker once the gateway has responded
+    weak_ptr<ix::WebSocket> weak_ws = ws;
+    weak_ptr<Connection> weak_conn = conn;
+    payments.submit(order_id, user_id, move(payment_method), move(key),
+        [weak_ws, weak_conn, user_id](bool paid, const string &detail)
+        {
+            auto ws = weak_ws.lock();
+            auto conn = weak_conn.lock();
+            if (!ws || !conn)
+                return;
+
+            if (paid)
+            {
+                ws->send("PAYMENT_SUCCESS|" + detail);
+                send_orders(user_id, *ws, conn->binary);
+            }
+            else
+            {
+                ws->send("ERROR|Payment processing failed: " + detail);
+            }
+        });
+}
+
+// GET_ORDERS|token[|cursor|limit]: cursor is the NEXT value from the previous
+// page, 0 for the newest orders
+void handle_get_orders(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    int cursor = 0;
+    int limit = 0;
+    if (parts.size() != 2 && parts.size() != 4)
+        return;
+    if (parts.size() == 4 && (!parse_number(parts[2], cursor) || !parse_number(parts[3], limit) ||
+                              cursor < 0 || limit < 0))
+    {
+        ws->send("ERROR|Invalid order page");
+        return;
+    }
+
+    int user_id = session_user_id(parts[1]);
+    if (user_id == -1) {
+        ws->send("ERROR|Invalid session");
+        return;
+    }
+
+    send_orders(user_id, *ws, conn->binary, cursor, static_cast<size_t>(limit));
+}
+
+void handle_admin(const Tokens &parts, const WsPtr &ws, const ConnPtr &)
+{
+    if (parts.size() < 3)
+        return;
+
+    if (session_user_id(parts[1]) != 1) // Assuming admin has ID 1
+    {
+        ws->send("ERROR|Admin privileges required");
+        return;
+    }
+
+    if (parts[2] == "STATS" && parts.size() == 3)
+    {
+        ws->send("STATS|" + metrics.summary());
+    }
+    else if (parts[2] == "RELOAD_ITEMS" && parts.size() == 3)
+    {
+        load_items_from_db();
+        ws->send("ADMIN_SUCCESS|Items reloaded");
+    }
+    else if (parts[2] == "ADD_ITEM" && parts.size() >= 6)
+    {
+        string name(parts[3]);
+        string listing_type(parts[4]);
+        double price;
+        int inventory = 1;
+        string description = parts.size() > 7 ? string(parts[7]) : name;
+        int64_t end_time = 0;
+        int duration = 0;  // Hours
+        
+        if (!parse_number(parts[5], price) ||
+            (parts.size() > 6 && !parse_number(parts[6], inventory)) ||
+            (listing_type == "auction" && parts.size() > 8 && !parse_number(parts[8], duration)))
+        {
+            ws->send("ERROR|Invalid item parameters");
+            return;
+        }
+        
+        if (listing_type == "auction" && parts.size() > 8) {
+            end_time = time(nullptr) + duration * 3600;
+        }
+        
+        if (add_item(name, description, listing_type, price, inventory, end_time))
+        {
+            ws->send("ADMIN_SUCCESS|Item added: " + name);
+        }
+        else
+        {
+            ws->send("ERROR|Failed to add item");
+        }
+    }
+}
+
+void handle_protocol(const Tokens &parts, const WsPtr &ws, const ConnPtr &conn)
+{
+    if (parts.size() != 2 || (parts[1] != "text" && parts[1] != "binary"))
+    {
+        ws->send("ERROR|Unsupported protocol");
+        return;
+    }
+
+    conn->binary = parts[1] == "binary";
+    ws->send("PROTOCOL|" + string(parts[1]));
+}
+
+// Command verbs are resolved through a perfect hash table computed at compile
+// time: one hash, one slot, one string compare per message.
+using Handler = void (*)(const Tokens &, const WsPtr &, const ConnPtr &);
+
+struct Command
+{
+    string_view verb;
+    Handler handler;
+};
+
+constexpr Command commands[] = {
+    {"LOGIN", handle_login},
+    {"GET_ITEMS", handle_get_items},
+    {"GET_ITEMS_SINCE", handle_get_items_since},
+    {"BID", handle_bid},
+    {"ADD_TO_CART", handle_add_to_cart},
+    {"UPDATE_CART", handle_update_cart},
+    {"GET_CART", handle_get_cart},
+    {"CHECKOUT", handle_checkout},
+    {"PROCESS_PAYMENT", handle_process_payment},
+    {"GET_ORDERS", handle_get_orders},
+    {"ADMIN", handle_admin},
+    {"PROTOCOL", handle_protocol},
+};
+
+constexpr size_t command_count = sizeof(commands) / sizeof(commands[0]);
+constexpr size_t dispatch_slots = 32;  // Power of two, comfortably above command_count
+
+constexpr uint32_t verb_hash(string_view verb, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;  // FNV-1a
+    for (char c : verb)
+    {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 16);  // FNV's low bits only see the seed's low bits
+}
+
+constexpr bool seed_is_perfect(uint32_t seed)
+{
+    bool used[dispatch_slots] = {};
+    for (const auto &command : commands)
+    {
+        size_t slot = verb_hash(command.verb, seed) & (dispatch_slots - 1);
+        if (used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_dispatch_seed()
+{
+    for (uint32_t seed = 1; seed < 100000; seed++)
+    {
+        if (seed_is_perfect(seed))
+            return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t dispatch_seed = find_dispatch_seed();
+static_assert(dispatch_seed != 0, "no collision-free seed; grow dispatch_slots");
+
+struct DispatchTable
+{
+    array<int8_t, dispatch_slots> slots{};
+
+    constexpr DispatchTable()
+    {
+        for (auto &slot : slots)
+            slot = -1;
+        for (size_t i = 0; i < command_count; i++)
+            slots[verb_hash(commands[i].verb, dispatch_seed) & (dispatch_slots - 1)] = static_cast<int8_t>(i);
+    }
+
+    const Command *find(string_view verb) const
+    {
+        int8_t index = slots[verb_hash(verb, dispatch_seed) & (dispatch_slots - 1)];
+        if (index < 0 || commands[index].verb != verb)
+            return nullptr;
+        return &commands[index];
+    }
+};
+
+constexpr DispatchTable dispatch_table;
+
+// Handler latency per verb, indexed like commands
+const vector<unique_ptr<Histogram>> command_latency = []
+{
+    vector<unique_ptr<Histogram>> histograms;
+    for (const auto &command : commands)
+    {
+        histograms.push_back(make_unique<Histogram>("ivory_command_duration_seconds",
+                                                    "command=\"" + string(command.verb) + "\"",
+                                                    "Time spent handling each command, dispatch to return"));
+    }
+    return histograms;
+}();
+
+void handle_message(const string &msg, const WsPtr &ws, const ConnPtr &conn)
+{
+    Tokens parts;
+    if (!tokenize(msg, '|', parts))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+
+    const Command *command = dispatch_table.find(parts[0]);
+    if (!command)
+        return;
+
+    ScopedTimer timer(*command_latency[command - commands]);
+    command->handler(parts, ws, conn);
+}
+
+// Binary frames from clients; only bids have a binary form
+void handle_binary_message(const string &msg, const WsPtr &ws)
+{
+    string_view in(msg);
+    uint8_t type;
+    int32_t item_id;
+    double amount;
+    if (!get_le(in, type) || type != static_cast<uint8_t>(WireType::Bid) ||
+        !get_le(in, item_id) || !get_le(in, amount) || !isfinite(amount))
+    {
+        ws->send("ERROR|Invalid message format");
+        return;
+    }
+
+    static const size_t bid_command = dispatch_table.find("BID") - commands;
+    ScopedTimer timer(*command_latency[bid_command]);
+    submit_bid(item_id, amount, in, ws);
+}
+
+// --------------------------
+// Background Threads
+// --------------------------
+void settle_auction(int item_id, int64_t end_time)
+{
+    auto closed = close_auction(item_id, end_time);
+    if (!closed)
+        return;
+    const Item &item = *closed;
+
+    // Turn the winning bid into an order; unsold auctions just close
+    int order_id = -1;
+    if (item.bidder_id > 0)
+    {
+        vector<pair<Item, int>> order_items = { {item, 1} };  // Quantity is always 1 for auction items
+        order_id = create_order(item.bidder_id, order_items, false);
+        if (order_id <= 0)
+        {
+            // Left open in SQLite so the next reload or restart settles it again
+            LOG(Error, "Failed to create order for auction ", item.id);
+            return;
+        }
+    }
+
+    // Clear end time and inventory to mark it as processed
+    {
+        lock_guard<mutex> db_lock(db_mutex);
+        auto update_stmt = db.statement(Stmt::CloseAuction);
+        sqlite3_bind_int(update_stmt, 1, item.id);
+        sqlite3_step(update_stmt);
+    }
+
+    broadcast(item_update(item));
+    if (order_id > 0)
+    {
+        // Broadcast notification to all users
+        broadcast("AUCTION_ENDED|" + to_string(item.id) + "," + 
+                 item.name + "," + to_string(item.current_bid) + "," + 
+                 to_string(item.bidder_id) + "," + to_string(order_id));
+    }
+}
+
+void session_cleanup_thread()
+{
+    while (true)
+    {
+        this_thread::sleep_for(chrono::minutes(1));
+
+        // Small batches keep logins and lookups flowing during a mass expiry
+        vector<int> ended;
+        while (sessions.expire_idle(256, ended) == 256)
+        {
+        }
+        for (int user_id : ended)
+        {
+            carts.unload(user_id);
+            order_history.forget(user_id);
+        }
+    }
+}
+
+// --------------------------
+// Server Lifecycle
+// --------------------------
+void start_services()
+{
+    logger.start(chrono::milliseconds(env_size("LOG_FLUSH_MS", 10)));
+    broadcast_hub.start(env_size("BROADCAST_SENDERS", min(4u, max(1u, thread::hardware_concurrency()))));
+    bid_journal.start(chrono::milliseconds(env_size("BID_FLUSH_MS", 5)), env_size("BID_FLUSH_BATCH", 512));
+    bid_engine.start(env_size("BID_WORKERS", max(1u, thread::hardware_concurrency())));
+    inventory.start(chrono::seconds(env_size("RESERVATION_TTL_S", 900)));
+    carts.start(chrono::milliseconds(env_size("CART_FLUSH_MS", 50)));
+    checkout_pipeline.start(chrono::milliseconds(env_size("CHECKOUT_WINDOW_MS", 2)), env_size("CHECKOUT_BATCH", 256));
+    payments.start(make_unique<LocalGateway>(chrono::milliseconds(env_size("PAYMENT_STUB_LATENCY_MS", 50)),
+                                             min<size_t>(env_size("PAYMENT_STUB_DECLINE_PCT", 0), 100)),
+                   env_size("PAYMENT_WORKERS", 4),
+                   chrono::seconds(env_size("PAYMENT_STALE_S", 300)));
+    auction_scheduler.start(settle_auction);
+    thread(session_cleanup_thread).detach();
+
+    metrics.gauge("ivory_connected_clients", "Open WebSocket connections",
+                  [] { return broadcast_hub.client_count(); });
+    metrics.gauge("ivory_broadcast_backlog_frames", "Frames queued for clients whose sockets are backed up",
+                  [] { return broadcast_hub.backlog(); });
+    metrics.gauge("ivory_bid_queue_depth", "Bids waiting for a bid engine worker",
+                  [] { return bid_engine.depth(); });
+    metrics.gauge("ivory_bid_journal_depth", "Settled bids waiting to be committed",
+                  [] { return bid_journal.depth(); });
+    metrics.gauge("ivory_checkout_queue_depth", "Checkouts waiting for the next batch",
+                  [] { return checkout_pipeline.depth(); });
+    metrics.gauge("ivory_payment_queue_depth", "Payments waiting for a worker",
+                  [] { return payments.depth(); });
+    metrics.gauge("ivory_carts_loaded", "Carts held in memory",
+                  [] { return carts.loaded(); });
+    metrics.start_dump(getenv("METRICS_FILE") ? getenv("METRICS_FILE") : "metrics.prom",
+                       chrono::seconds(env_size("METRICS_DUMP_S", 10)));
+}
+
+void log_info(const string &message)
+{
+    LOG(Info, message);
+}
+
+void log_fatal(const string &message)
+{
+    LOG(Error, message);
+    logger.flush();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <ixwebsocket/IXWebSocket.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The bidding server's logic, without the WebSocket listener. main.cpp
+// accepts connections and feeds their frames to handle_message; benchmarks
+// link the same library and drive these entry points directly. Everything
+// else (the engines, stores and their globals) stays private to bidding.cpp.
+
+// --------------------------
+// Core Data Structures
+// --------------------------
+
+// A broadcast frame is serialized once and shared by every recipient.
+using Frame = std::shared_ptr<const std::string>;
+
+struct CartItem {
+    int item_id;
+    int quantity;
+    double price;  // fixed_price as of the last change to this line
+    std::string name;
+};
+
+struct Cart
+{
+    std::vector<CartItem> lines;  // In the order items were first added
+    double total = 0.0;           // Recomputed on every change, never on read
+};
+
+// Per-socket state, owned by the socket's message callback
+struct Connection
+{
+    std::weak_ptr<ix::WebSocket> ws;
+    std::atomic<bool> binary{false};  // Switched on by PROTOCOL|binary
+};
+
+struct Item
+{
+    int id;
+    std::string name;
+    std::string description;
+    std::string listing_type;  // "auction" or "fixed"
+    double current_bid = 0.0;
+    double fixed_price = 0.0;
+    int inventory = 1;
+    int bidder_id = -1;
+    int64_t end_time = 0;  // Unix timestamp for auction end
+    int version = 1;
+    uint64_t changed_at = 0;  // Catalog version of its last change, set by Catalog::touch
+    std::string wire;      // Cached ITEMS_LIST entry, refreshed by Catalog::touch
+    std::string record;    // Cached binary item record, refreshed alongside wire
+};
+
+struct PendingBid
+{
+    int user_id;
+    double amount;
+    std::weak_ptr<ix::WebSocket> ws;
+    std::chrono::steady_clock::time_point received;
+};
+
+// Fields of one '|'-delimited frame, as views into the original message.
+struct Tokens
+{
+    static constexpr size_t max_fields = 16;
+    std::array<std::string_view, max_fields> fields;
+    size_t count = 0;
+
+    size_t size() const { return count; }
+    std::string_view operator[](size_t i) const { return fields[i]; }
+};
+
+// --------------------------
+// Server Lifecycle
+// --------------------------
+extern const char *const database_path;
+
+// Accepts SQLite URI filenames, e.g. "file:bench?mode=memory&cache=shared"
+void init_database(const char *path = database_path);
+void seed_test_data();
+void load_items_from_db();
+
+// Starts every background worker, tuned from the environment
+void start_services();
+
+// User id, or -1 for bad credentials
+int authenticate_user(const std::string &username, const std::string &password);
+// Logs the user in on conn and returns the new session token
+std::string start_session(int user_id, const std::shared_ptr<Connection> &conn);
+
+void connect_client(ix::WebSocket *ws, std::shared_ptr<Connection> conn);
+void disconnect_client(ix::WebSocket *ws);
+
+void handle_message(const std::string &msg, const std::shared_ptr<ix::WebSocket> &ws,
+                    const std::shared_ptr<Connection> &conn);
+void handle_binary_message(const std::string &msg, const std::shared_ptr<ix::WebSocket> &ws);
+
+void log_info(const std::string &message);
+// Logs and writes out everything buffered, for use before exiting
+void log_fatal(const std::string &message);
+
+// --------------------------
+// Hot Paths
+// --------------------------
+bool tokenize(std::string_view msg, char delimiter, Tokens &out);
+std::string generate_uuid();
+
+// ITEMS_LIST as GET_ITEMS serves it
+Frame items_list(bool binary);
+std::string cart_message(const Cart &cart, bool binary);
+// ITEM_UPDATE for an item as a change to it would broadcast it; null if there is no such item
+Frame item_update_frame(int item_id, bool binary);
+
+void process_bids(int item_id, std::vector<PendingBid> &bids);
+
+// Blocks until the batch holding this order has committed; -1 on failure
+int create_order(int user_id, const std::vector<std::pair<Item, int>> &items, bool from_cart = true);
+
+void broadcast(const std::string &message);
+// Blocks until every broadcast so far has been handed to each client
+void wait_for_broadcasts();
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// HdrHistogram-style log-linear histogram, shared by the server's metrics and
+// ivory_loadgen so both report percentiles from the same buckets: 16 linear
+// sub-buckets per power of two, so a recorded value is reported to within
+// about 6%. The histogram is split into stripes and a thread always records
+// into the same stripe, so recording is a couple of relaxed atomic adds on a
+// line other threads rarely touch. Readers sum the stripes.
+class LogHistogram
+{
+public:
+    static constexpr size_t sub_buckets = 16;
+    static constexpr size_t max_exponent = 40;  // Values from 2^40 up share the top bucket
+    static constexpr size_t bucket_count = (max_exponent - 3) * sub_buckets;
+    static constexpr size_t stripe_count = 8;
+
+    struct Snapshot
+    {
+        std::array<uint64_t, bucket_count> counts{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        // Highest value in the bucket holding the q-th quantile, capped at max
+        uint64_t percentile(double q) const
+        {
+            if (count == 0)
+                return 0;
+            uint64_t rank = std::max(uint64_t{1}, static_cast<uint64_t>(std::ceil(q * count)));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; i++)
+            {
+                seen += counts[i];
+                if (seen >= rank)
+                    return i + 1 < bucket_count ? std::min(bucket_floor(i + 1) - 1, max) : max;
+            }
+            return max;
+        }
+    };
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::array<std::atomic<uint64_t>, bucket_count> counts{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    std::array<Stripe, stripe_count> stripes;
+
+    static size_t bucket_for(uint64_t value)
+    {
+        if (value < sub_buckets)
+            return value;
+        size_t exponent = 63 - __builtin_clzll(value);
+        if (exponent >= max_exponent)
+            return bucket_count - 1;
+        return (exponent - 3) * sub_buckets + ((value >> (exponent - 4)) & (sub_buckets - 1));
+    }
+
+    static uint64_t bucket_floor(size_t bucket)
+    {
+        if (bucket < sub_buckets)
+            return bucket;
+        size_t exponent = bucket / sub_buckets + 3;
+        return (sub_buckets + bucket % sub_buckets) << (exponent - 4);
+    }
+
+    static size_t local_stripe()
+    {
+        static std::atomic<size_t> next{0};
+        thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % stripe_count;
+        return stripe;
+    }
+
+public:
+    LogHistogram() = default;
+    LogHistogram(const LogHistogram &) = delete;
+    LogHistogram &operator=(const LogHistogram &) = delete;
+
+    void record(uint64_t value)
+    {
+        Stripe &stripe = stripes[local_stripe()];
+        stripe.counts[bucket_for(value)].fetch_add(1, std::memory_order_relaxed);
+        stripe.sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t seen = stripe.max.load(std::memory_order_relaxed);
+        while (value > seen && !stripe.max.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Records a duration in nanoseconds
+    void record(std::chrono::steady_clock::duration elapsed)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        record(static_cast<uint64_t>(std::max<int64_t>(ns, 0)));
+    }
+
+    void record_since(std::chrono::steady_clock::time_point start)
+    {
+        record(std::chrono::steady_clock::now() - start);
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot snap;
+        for (const Stripe &stripe : stripes)
+        {
+            for (size_t i = 0; i < bucket_count; i++)
+            {
+                uint64_t n = stripe.counts[i].load(std::memory_order_relaxed);
+                snap.counts[i] += n;
+                snap.count += n;
+            }
+            snap.sum += stripe.sum.load(std::memory_order_relaxed);
+            snap.max = std::max(snap.max, stripe.max.load(std::memory_order_relaxed));
+        }
+        return snap;
+    }
+};
@@ -3,18 +3,39 @@
 #define AUTH_SERVICE_H
 
 #include "database.h"
+#include "password_hasher.h"
+#include <chrono>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 
 class AuthService {
     Storage& db;
-    std::mutex authMutex;
+    PasswordHasher& hasher;
+    std::mutex authMutex;  // Guards the database only; hashing runs on the hasher's pool
+
+    // Session token -> user, so authenticated requests skip SQLite. Entries
+    // live for sessionTtl and are dropped on login (the old token) and logout.
+    struct CachedSession {
+        User user;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::unordered_map<std::string, CachedSession> sessionCache;
+    std::shared_mutex sessionMutex;
+    std::chrono::seconds sessionTtl;
+    size_t insertsSinceSweep = 0;
+
+    void evictSession(const std::string& sessionId);
 
 public:
-    AuthService(Storage& database);
+    AuthService(Storage& database, PasswordHasher& passwordHasher,
+                std::chrono::seconds sessionTtl = std::chrono::minutes(5));
     std::string login(const std::string& email, const std::string& password);
     User getUserFromSession(const std::string& sessionId);
+    void logout(const std::string& sessionId);
     std::string registerUser(const std::string& name, const std::string& email, const std::string& password);
+    PasswordHasher::Stats hashingStats() const { return hasher.stats(); }
 };
 
 
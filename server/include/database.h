@@ -42,6 +42,7 @@ struct Payment {
 
 // define Storage (the actual database type)
 using Storage = decltype(sql::make_storage("dummy.db",
+    sql::make_index("idx_users_session", &User::sessionId),
     sql::make_table("Users",
         sql::make_column("id", &User::id, sql::primary_key().autoincrement()),
         sql::make_column("name", &User::name),
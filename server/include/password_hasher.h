@@ -0,0 +1,82 @@
+// include/password_hasher.h
+#ifndef PASSWORD_HASHER_H
+#define PASSWORD_HASHER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Thrown when the hashing queue is full; the caller should retry later.
+class HasherBusy : public std::runtime_error {
+public:
+    HasherBusy() : std::runtime_error("Server busy, try again shortly") {}
+};
+
+// Runs Argon2 hashing and verification on a fixed pool of worker threads, so
+// password checks never hold a lock and never run more at once than the
+// cores and memory budget allow. Each job takes crypto_pwhash_MEMLIMIT_INTERACTIVE
+// bytes (64 MB), so the pool is the smaller of the core count and the
+// budget divided by that. At most maxQueued jobs wait; anything beyond that
+// is rejected with HasherBusy instead of queueing for seconds.
+class PasswordHasher {
+public:
+    struct Stats {
+        size_t workers;
+        size_t queued;        // Waiting for a worker right now
+        size_t running;       // Being hashed right now
+        uint64_t completed;
+        uint64_t rejected;    // Turned away because the queue was full
+        double avgWaitMs;     // Mean time from submit to a worker picking it up
+        double avgHashMs;     // Mean time spent inside libsodium
+    };
+
+    // 0 picks the default: one worker per core, a 1 GB memory budget and a
+    // queue of 64 jobs per worker.
+    explicit PasswordHasher(size_t threads = 0, size_t memoryBudgetBytes = 0, size_t maxQueued = 0);
+    ~PasswordHasher();
+
+    PasswordHasher(const PasswordHasher&) = delete;
+    PasswordHasher& operator=(const PasswordHasher&) = delete;
+
+    // Both block until a worker has finished the job. Throw HasherBusy if
+    // the queue is full, std::runtime_error if libsodium runs out of memory.
+    std::string hash(const std::string& password);
+    bool verify(const std::string& hash, const std::string& password);
+
+    Stats stats() const;
+
+private:
+    struct Job {
+        std::function<void()> work;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void submit(std::function<void()> work);
+    void workerLoop();
+
+    size_t maxQueued;
+    std::vector<std::thread> workers;
+
+    mutable std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<Job> queue;
+    bool stopping = false;
+
+    std::atomic<size_t> running{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> waitMicros{0};
+    std::atomic<uint64_t> hashMicros{0};
+};
+
+#endif
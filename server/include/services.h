@@ -2,18 +2,24 @@
 #define SERVICES_H
 
 #include "database.h"
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 
 class InventoryService {
     Storage& db;
     std::mutex inventoryMutex;
+    std::atomic<uint64_t> version{0};  // Bumped on every stock change
     
 public:
     InventoryService(Storage& database) : db(database) {}
 
+    // Anything cached from the Products table is stale once this moves
+    uint64_t stockVersion() const { return version.load(std::memory_order_acquire); }
+
     bool reserveStock(int productId, int quantity) {
         std::lock_guard<std::mutex> lock(inventoryMutex);
-        return db.transaction([&] {
+        bool reserved = db.transaction([&] {
             auto product = db.get<Product>(productId);
             if (product.stock >= quantity) {
                 product.stock -= quantity;
@@ -22,6 +28,8 @@ public:
             }
             return false;
         });
+        if (reserved) version.fetch_add(1, std::memory_order_release);
+        return reserved;
     }
 };
 
@@ -1,7 +1,6 @@
 #include "auth.h"
 #include <sstream>
 #include <random>
-#include <sodium.h>  
 
 // Generate a session ID
 std::string generateSessionId() {
@@ -13,62 +12,100 @@ std::string generateSessionId() {
     return ss.str();
 }
 
-AuthService::AuthService(Storage& database) : db(database) {}
+AuthService::AuthService(Storage& database, PasswordHasher& passwordHasher, std::chrono::seconds sessionTtl)
+    : db(database), hasher(passwordHasher), sessionTtl(sessionTtl) {}
+
+void AuthService::evictSession(const std::string& sessionId) {
+    if (sessionId.empty()) return;
+    std::unique_lock<std::shared_mutex> lock(sessionMutex);
+    sessionCache.erase(sessionId);
+}
 
 std::string AuthService::login(const std::string& email, const std::string& password) {
-    std::lock_guard<std::mutex> lock(authMutex);
-    auto users = db.get_all<User>(sql::where(sql::c(&User::email) == email));
+    std::vector<User> users;
+    {
+        std::lock_guard<std::mutex> lock(authMutex);
+        users = db.get_all<User>(sql::where(sql::c(&User::email) == email));
+    }
 
-    if (!users.empty()) {
-        // Verify the password using libsodium's crypto_pwhash_str_verify.
-        // crypto_pwhash_str_verify returns 0 on successful verification.
-        if (crypto_pwhash_str_verify(users[0].passwordHash.c_str(), password.c_str(), password.size()) == 0) {
-            std::string sessionId = generateSessionId();
-            User user = users[0];
-            user.sessionId = sessionId;
-            db.update(user);
-            return sessionId;
-        }
+    // Verify outside the lock so one slow Argon2 check doesn't hold up every other login
+    if (!users.empty() && hasher.verify(users[0].passwordHash, password)) {
+        std::lock_guard<std::mutex> lock(authMutex);  // Also guards generateSessionId's rng
+        std::string sessionId = generateSessionId();
+        User user = db.get<User>(users[0].id);  // Re-read: another login may have changed the session
+        evictSession(user.sessionId);  // Logging in again replaces the previous session
+        user.sessionId = sessionId;
+        db.update(user);
+        return sessionId;
     }
     throw std::runtime_error("Invalid credentials");
 }
 
 User AuthService::getUserFromSession(const std::string& sessionId) {
+    // Users who have never logged in have an empty sessionId
+    if (sessionId.empty()) throw std::runtime_error("Unauthorized");
+
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::shared_lock<std::shared_mutex> lock(sessionMutex);
+        auto it = sessionCache.find(sessionId);
+        if (it != sessionCache.end() && it->second.expires > now) return it->second.user;
+    }
+
+    // Miss: indexed lookup (idx_users_session). The cache is filled under
+    // authMutex too, so a concurrent login or logout can't evict the token
+    // between our read and our insert.
+    std::lock_guard<std::mutex> dbLock(authMutex);
     auto users = db.get_all<User>(sql::where(sql::c(&User::sessionId) == sessionId));
-    if (!users.empty()) return users[0];
-    throw std::runtime_error("Unauthorized");
+    if (users.empty()) throw std::runtime_error("Unauthorized");
+
+    std::unique_lock<std::shared_mutex> lock(sessionMutex);
+    // Drop expired sessions now and then so tokens nobody uses again don't pile up
+    if (++insertsSinceSweep >= 1024) {
+        insertsSinceSweep = 0;
+        for (auto it = sessionCache.begin(); it != sessionCache.end();) {
+            if (it->second.expires <= now) it = sessionCache.erase(it);
+            else ++it;
+        }
+    }
+    sessionCache[sessionId] = {users[0], now + sessionTtl};
+    return users[0];
 }
 
-std::string AuthService::registerUser(const std::string& name, const std::string& email, const std::string& password) {
+void AuthService::logout(const std::string& sessionId) {
+    if (sessionId.empty()) return;
     std::lock_guard<std::mutex> lock(authMutex);
+    db.update_all(sql::set(sql::c(&User::sessionId) = ""),
+                  sql::where(sql::c(&User::sessionId) == sessionId));
+    evictSession(sessionId);
+}
+
+std::string AuthService::registerUser(const std::string& name, const std::string& email, const std::string& password) {
     // Check if email already exists
-    auto users = db.get_all<User>(sql::where(sql::c(&User::email) == email));
-    if (!users.empty()) {
-        throw std::runtime_error("Email already registered");
-    }
-    
-    // Buffer for the hashed password; crypto_pwhash_STRBYTES defines the required size.
-    char hashed[crypto_pwhash_STRBYTES];
-    
-    // Hash the password using libsodium's crypto_pwhash_str with interactive parameters.
-    if (crypto_pwhash_str(
-            hashed,
-            password.c_str(),
-            password.size(),
-            crypto_pwhash_OPSLIMIT_INTERACTIVE,
-            crypto_pwhash_MEMLIMIT_INTERACTIVE) != 0) {
-        throw std::runtime_error("Out of memory while hashing password");
+    {
+        std::lock_guard<std::mutex> lock(authMutex);
+        auto users = db.get_all<User>(sql::where(sql::c(&User::email) == email));
+        if (!users.empty()) {
+            throw std::runtime_error("Email already registered");
+        }
     }
-    
-    std::string hashedPassword = hashed;
-    
+
+    // Hash on the hasher's pool with interactive parameters, outside the lock
+    std::string hashedPassword = hasher.hash(password);
+
     // Create new user record
     User newUser;
     newUser.name = name;
     newUser.email = email;
     newUser.passwordHash = hashedPassword;
     newUser.sessionId = "";  // sessionId remains empty until login
+
+    std::lock_guard<std::mutex> lock(authMutex);
+    // Someone may have registered the same email while we were hashing
+    if (!db.get_all<User>(sql::where(sql::c(&User::email) == email)).empty()) {
+        throw std::runtime_error("Email already registered");
+    }
     db.insert(newUser);
-    
+
     return "Registration successful";
 }
@@ -4,6 +4,9 @@ using namespace sqlite_orm;
 Storage initStorage(const std::string& filename) {
     return make_storage(
         filename,
+        // getUserFromSession looks users up by session token
+        make_index("idx_users_session", &User::sessionId),
+
         make_table("Users",
             make_column("id", &User::id, primary_key().autoincrement()),
             make_column("name", &User::name),
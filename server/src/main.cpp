@@ -2,17 +2,31 @@
 #include "database.h"
 #include "services.h"
 #include "auth.h"
+#include "password_hasher.h"
+#include <cstdlib>
 #include "routes.h" // Include the header file where setupRoutes is declared
 
 // httplib
 
+// Reads a size from the environment, or 0 (use the default) if unset
+static size_t envSize(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? std::strtoull(value, nullptr, 10) : 0;
+}
+
 int main() {
     crow::SimpleApp app;
 
     auto db = initStorage("ecommerce.db");
     db.sync_schema();
 
-    AuthService authService(db);
+    // HASH_THREADS, HASH_MEMORY_MB and HASH_QUEUE bound concurrent Argon2 work
+    PasswordHasher passwordHasher(envSize("HASH_THREADS"),
+                                  envSize("HASH_MEMORY_MB") << 20,
+                                  envSize("HASH_QUEUE"));
+    // SESSION_TTL_S bounds how long a cached session skips the database
+    size_t sessionTtl = envSize("SESSION_TTL_S");
+    AuthService authService(db, passwordHasher, std::chrono::seconds(sessionTtl ? sessionTtl : 300));
     InventoryService inventoryService(db);
 
     CROW_ROUTE(app, "/")
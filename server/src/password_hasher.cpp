@@ -0,0 +1,129 @@
+#include "password_hasher.h"
+#include <algorithm>
+#include <sodium.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t microsSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+} // namespace
+
+PasswordHasher::PasswordHasher(size_t threads, size_t memoryBudgetBytes, size_t maxQueued) {
+    if (sodium_init() < 0)
+        throw std::runtime_error("libsodium failed to initialize");
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (memoryBudgetBytes == 0)
+        memoryBudgetBytes = size_t(1) << 30;
+
+    // Never run more jobs than the memory budget can hold at once
+    size_t byMemory = std::max<size_t>(1, memoryBudgetBytes / crypto_pwhash_MEMLIMIT_INTERACTIVE);
+    threads = std::min(threads, byMemory);
+
+    this->maxQueued = maxQueued ? maxQueued : threads * 64;
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back(&PasswordHasher::workerLoop, this);
+}
+
+PasswordHasher::~PasswordHasher() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCv.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void PasswordHasher::submit(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (queue.size() >= maxQueued) {
+            rejected++;
+            throw HasherBusy();
+        }
+        queue.push_back({std::move(work), Clock::now()});
+    }
+    queueCv.notify_one();
+}
+
+void PasswordHasher::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;  // Stopping, and everything queued has been run
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        waitMicros += microsSince(job.submitted);
+        running++;
+        auto start = Clock::now();
+        job.work();
+        hashMicros += microsSince(start);
+        running--;
+        completed++;
+    }
+}
+
+std::string PasswordHasher::hash(const std::string& password) {
+    std::promise<std::string> result;
+    auto future = result.get_future();
+
+    submit([&] {
+        // Buffer for the hashed password; crypto_pwhash_STRBYTES defines the required size.
+        char hashed[crypto_pwhash_STRBYTES];
+        if (crypto_pwhash_str(
+                hashed,
+                password.c_str(),
+                password.size(),
+                crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                crypto_pwhash_MEMLIMIT_INTERACTIVE) != 0) {
+            result.set_exception(std::make_exception_ptr(
+                std::runtime_error("Out of memory while hashing password")));
+            return;
+        }
+        result.set_value(hashed);
+    });
+
+    return future.get();
+}
+
+bool PasswordHasher::verify(const std::string& hash, const std::string& password) {
+    std::promise<bool> result;
+    auto future = result.get_future();
+
+    submit([&] {
+        // crypto_pwhash_str_verify returns 0 on successful verification.
+        result.set_value(crypto_pwhash_str_verify(hash.c_str(), password.c_str(), password.size()) == 0);
+    });
+
+    return future.get();
+}
+
+PasswordHasher::Stats PasswordHasher::stats() const {
+    Stats s{};
+    s.workers = workers.size();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        s.queued = queue.size();
+    }
+    s.running = running;
+    s.completed = completed;
+    s.rejected = rejected;
+    if (s.completed) {
+        s.avgWaitMs = waitMicros / 1000.0 / s.completed;
+        s.avgHashMs = hashMicros / 1000.0 / s.completed;
+    }
+    return s;
+}
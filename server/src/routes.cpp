@@ -3,6 +3,104 @@
 #include "database.h"
 #include "auth.h"
 #include "auth.cpp"
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <zlib.h>
+
+namespace {
+
+// One encoding of the /api/products body, built once per stock version
+struct ProductsBody {
+    uint64_t version;
+    std::string json;
+    std::string gzip;
+    std::string etag;      // Strong validator for the identity encoding
+    std::string gzipEtag;  // Strong validators differ per encoding
+};
+
+std::string gzipCompress(const std::string& data) {
+    z_stream zs{};
+    // 15 + 16: zlib's default window, wrapped in a gzip header
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return "";
+
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END ? out : "";
+}
+
+// FNV-1a, so the tag only changes when the body does and survives restarts
+std::string contentTag(const std::string& body) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : body) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    std::stringstream ss;
+    ss << '"' << std::hex << h << '"';
+    return ss.str();
+}
+
+// True if the Accept-Encoding header allows gzip (and doesn't give it q=0)
+bool acceptsGzip(const std::string& header) {
+    std::stringstream ss(header);
+    std::string coding;
+    while (std::getline(ss, coding, ',')) {
+        auto params = coding.find(';');
+        std::string name = coding.substr(0, params);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        if (name != "gzip" && name != "*") continue;
+
+        if (params == std::string::npos) return true;
+        auto q = coding.find("q=", params);
+        return q == std::string::npos || std::strtod(coding.c_str() + q + 2, nullptr) > 0;
+    }
+    return false;
+}
+
+// True if any entity tag in If-None-Match matches (weak comparison, per RFC 9110)
+bool etagMatches(const std::string& header, const std::string& etag) {
+    std::stringstream ss(header);
+    std::string tag;
+    while (std::getline(ss, tag, ',')) {
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+        if (tag == "*" || tag == etag) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const ProductsBody> buildProductsBody(Storage& db, uint64_t version) {
+    auto products = db.get_all<Product>();
+    crow::json::wvalue result;
+    result["products"] = crow::json::wvalue::list(products.size());
+    for (size_t i = 0; i < products.size(); ++i) {
+        result["products"][i]["id"] = products[i].id;
+        result["products"][i]["name"] = products[i].name;
+        result["products"][i]["price"] = products[i].price;
+        result["products"][i]["stock"] = products[i].stock;
+    }
+
+    auto body = std::make_shared<ProductsBody>();
+    body->version = version;
+    body->json = result.dump();
+    body->gzip = gzipCompress(body->json);
+    body->etag = contentTag(body->json);
+    body->gzipEtag = body->etag.substr(0, body->etag.size() - 1) + "-gzip\"";
+    return body;
+}
+
+} // namespace
 
 void setupRoutes(crow::SimpleApp& app, AuthService& auth, InventoryService& inventory, Storage& db) {
     CROW_ROUTE(app, "/api/login").methods("POST"_method)
@@ -13,6 +111,12 @@ void setupRoutes(crow::SimpleApp& app, AuthService& auth, InventoryService& inve
             crow::json::wvalue result;
             result["token"] = token;
             return crow::response{200, result};
+        } catch (const HasherBusy& e) {
+            crow::json::wvalue error;
+            error["error"] = e.what();
+            crow::response res{503, error};
+            res.set_header("Retry-After", "1");
+            return res;
         } catch (const std::runtime_error& e) {
             crow::json::wvalue error;
             error["error"] = e.what();
@@ -31,6 +135,12 @@ void setupRoutes(crow::SimpleApp& app, AuthService& auth, InventoryService& inve
             crow::json::wvalue result;
             result["message"] = message;
             return crow::response{201, result};
+        } catch (const HasherBusy& e) {
+            crow::json::wvalue error;
+            error["error"] = e.what();
+            crow::response res{503, error};
+            res.set_header("Retry-After", "1");
+            return res;
         } catch (const std::runtime_error& e) {
             crow::json::wvalue error;
             error["error"] = e.what();
@@ -38,21 +148,69 @@ void setupRoutes(crow::SimpleApp& app, AuthService& auth, InventoryService& inve
         }
     });
 
+    CROW_ROUTE(app, "/api/logout").methods("POST"_method)
+    ([&auth](const crow::request& req) {
+        auto json = crow::json::load(req.body);
+        if (!json || !json.has("token")) return crow::response(400);
+        auth.logout(json["token"].s());
+        return crow::response(204);
+    });
 
-    CROW_ROUTE(app, "/api/products").methods("GET"_method)
-    ([&db]() {
-        auto products = db.get_all<Product>();
+    // Operator-only: queue state would help time or size a login flood, so
+    // it is only served to local monitoring
+    CROW_ROUTE(app, "/api/auth/stats").methods("GET"_method)
+    ([&auth](const crow::request& req) {
+        if (req.remote_ip_address != "127.0.0.1" && req.remote_ip_address != "::1")
+            return crow::response(403);
+        auto stats = auth.hashingStats();
         crow::json::wvalue result;
-        result["products"] = crow::json::wvalue::list(products.size());
-        for (size_t i = 0; i < products.size(); ++i) {
-            result["products"][i]["id"] = products[i].id;
-            result["products"][i]["name"] = products[i].name;
-            result["products"][i]["price"] = products[i].price;
-            result["products"][i]["stock"] = products[i].stock;
-        }
+        result["workers"] = stats.workers;
+        result["queued"] = stats.queued;
+        result["running"] = stats.running;
+        result["completed"] = stats.completed;
+        result["rejected"] = stats.rejected;
+        result["avgWaitMs"] = stats.avgWaitMs;
+        result["avgHashMs"] = stats.avgHashMs;
         return crow::response{200, result};
     });
 
+    // Product listings are read far more often than stock changes, so the
+    // encoded body (plain and gzipped) is cached until InventoryService
+    // reports a new stock version.
+    auto productsCache = std::make_shared<std::shared_ptr<const ProductsBody>>();
+    auto productsMutex = std::make_shared<std::mutex>();
+
+    CROW_ROUTE(app, "/api/products").methods("GET"_method)
+    ([&db, &inventory, productsCache, productsMutex](const crow::request& req) {
+        std::shared_ptr<const ProductsBody> body;
+        {
+            std::lock_guard<std::mutex> lock(*productsMutex);
+            // Read the version before the table, so a change made mid-build
+            // leaves the cache stale rather than wrongly current
+            uint64_t version = inventory.stockVersion();
+            if (!*productsCache || (*productsCache)->version != version)
+                *productsCache = buildProductsBody(db, version);
+            body = *productsCache;
+        }
+
+        bool gzip = !body->gzip.empty() && acceptsGzip(req.get_header_value("Accept-Encoding"));
+        const std::string& etag = gzip ? body->gzipEtag : body->etag;
+
+        crow::response res;
+        res.set_header("ETag", etag);
+        res.set_header("Vary", "Accept-Encoding");
+        if (etagMatches(req.get_header_value("If-None-Match"), etag)) {
+            res.code = 304;
+            return res;
+        }
+
+        res.code = 200;
+        res.set_header("Content-Type", "application/json");
+        if (gzip) res.set_header("Content-Encoding", "gzip");
+        res.body = gzip ? body->gzip : body->json;
+        return res;
+    });
+
     CROW_ROUTE(app, "/api/checkout").methods("POST"_method)
     ([&db](const crow::request& req) {
         auto json = crow::json::load(req.body);
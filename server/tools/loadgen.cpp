@@ -0,0 +1,679 @@
+#include "histogram.h"
+#include "wire.h"
+
+#include <ixwebsocket/IXNetSystem.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Closed-loop load generator for the bidding server. Every connection logs
+// in as one of the seeded users and then keeps exactly one request in
+// flight, picking each next request from a weighted mix. The protocol has no
+// request ids, so with one outstanding request the next matching reply on
+// that socket is its answer.
+//
+//   ivory_loadgen --connections 2000 --duration 30 --mix bid=50,cart=20,items=30
+//
+// With --protocol binary every connection switches to the binary wire format
+// and decodes each binary frame it gets; frames that don't decode are
+// counted and reported as malformed.
+//
+// IXWebSocket runs one thread per client socket; raise `ulimit -n` and the
+// thread limit before going into the thousands.
+
+// --------------------------
+// Options
+// --------------------------
+struct Options
+{
+    string url = "ws://127.0.0.1:8080";
+    size_t connections = 100;
+    size_t duration_s = 30;
+    size_t ramp_per_s = 500;  // Connections opened per second
+    size_t think_ms = 0;      // Pause between a reply and the next request
+    bool binary = false;      // --protocol binary
+    vector<pair<string, string>> users = {{"user1", "pass1"}, {"user2", "pass2"}};
+    map<string, size_t> mix = {{"bid", 50}, {"cart", 20}, {"checkout", 5}, {"items", 15}, {"orders", 10}};
+};
+
+void usage()
+{
+    fprintf(stderr,
+            "usage: ivory_loadgen [--url ws://127.0.0.1:8080] [--connections N] [--duration S]\n"
+            "                     [--ramp N_PER_S] [--think-ms MS] [--users u:p,u:p]\n"
+            "                     [--protocol text|binary]\n"
+            "                     [--mix bid=50,cart=20,checkout=5,items=15,orders=10]\n");
+}
+
+vector<string> split(const string &text, char delimiter)
+{
+    vector<string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = text.find(delimiter, start);
+        fields.push_back(text.substr(start, end - start));
+        if (end == string::npos)
+            return fields;
+        start = end + 1;
+    }
+}
+
+bool parse_size(const char *text, size_t &out)
+{
+    char *end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || *end != '\0')
+        return false;
+    out = value;
+    return true;
+}
+
+// Only loopback targets, so a run can never be pointed at a shared server
+bool is_local(const string &url)
+{
+    for (const char *host : {"ws://127.0.0.1", "ws://localhost", "ws://[::1]"})
+    {
+        size_t n = strlen(host);
+        if (url.compare(0, n, host) == 0 && (url.size() == n || url[n] == ':' || url[n] == '/'))
+            return true;
+    }
+    return false;
+}
+
+bool parse_options(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string flag = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+
+        if (flag == "--url")
+        {
+            options.url = value;
+        }
+        else if (flag == "--connections")
+        {
+            if (!parse_size(value, options.connections) || options.connections == 0)
+                return false;
+        }
+        else if (flag == "--duration")
+        {
+            if (!parse_size(value, options.duration_s) || options.duration_s == 0)
+                return false;
+        }
+        else if (flag == "--ramp")
+        {
+            if (!parse_size(value, options.ramp_per_s) || options.ramp_per_s == 0)
+                return false;
+        }
+        else if (flag == "--think-ms")
+        {
+            if (!parse_size(value, options.think_ms))
+                return false;
+        }
+        else if (flag == "--protocol")
+        {
+            if (strcmp(value, "text") != 0 && strcmp(value, "binary") != 0)
+                return false;
+            options.binary = strcmp(value, "binary") == 0;
+        }
+        else if (flag == "--users")
+        {
+            options.users.clear();
+            for (const string &entry : split(value, ','))
+            {
+                size_t colon = entry.find(':');
+                if (colon == string::npos)
+                    return false;
+                options.users.emplace_back(entry.substr(0, colon), entry.substr(colon + 1));
+            }
+        }
+        else if (flag == "--mix")
+        {
+            options.mix.clear();
+            for (const string &entry : split(value, ','))
+            {
+                size_t equals = entry.find('=');
+                size_t weight;
+                if (equals == string::npos || !parse_size(entry.c_str() + equals + 1, weight))
+                    return false;
+                options.mix[entry.substr(0, equals)] = weight;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (!is_local(options.url))
+    {
+        fprintf(stderr, "refusing non-local url %s\n", options.url.c_str());
+        return false;
+    }
+    return !options.users.empty();
+}
+
+// --------------------------
+// Shared State
+// --------------------------
+enum class Kind
+{
+    Bid,
+    Cart,
+    Checkout,
+    Items,
+    Orders,
+    Count,
+};
+
+const char *const kind_names[] = {"bid", "cart", "checkout", "items", "orders"};
+
+struct Stats
+{
+    // Latencies in nanoseconds; every socket thread records into the same ones
+    array<LogHistogram, static_cast<size_t>(Kind::Count)> request;  // Request to its reply
+    array<atomic<uint64_t>, static_cast<size_t>(Kind::Count)> errors{};
+    LogHistogram bid_broadcast;  // Bid sent to the bidder seeing it in ITEM_UPDATE
+    LogHistogram login;
+    atomic<uint64_t> logged_in{0};
+    atomic<uint64_t> failed{0};  // Connections that errored or closed
+    atomic<uint64_t> malformed{0};  // Binary frames that did not decode
+};
+
+Stats stats;
+atomic<bool> running{true};
+
+// Items worth targeting, read from ITEMS_LIST before the run starts
+struct Catalog
+{
+    vector<int> auctions;
+    vector<int> fixed;
+    unique_ptr<atomic<int64_t>[]> next_bid;  // Per auction, strictly increasing
+    unordered_map<int, size_t> auction_index;
+};
+
+Catalog catalog;
+
+// ITEMS_LIST / ITEM_UPDATE entry: id,name,listing_type,current_bid,fixed_price,inventory,bidder_id,end_time
+struct ItemFields
+{
+    int id;
+    string listing_type;
+    double current_bid;
+    int inventory;
+    int64_t end_time;
+};
+
+bool parse_item(const string &entry, ItemFields &item)
+{
+    auto fields = split(entry, ',');
+    if (fields.size() != 8)
+        return false;
+    item.id = atoi(fields[0].c_str());
+    item.listing_type = fields[2];
+    item.current_bid = atof(fields[3].c_str());
+    item.inventory = atoi(fields[5].c_str());
+    item.end_time = atoll(fields[7].c_str());
+    return true;
+}
+
+void load_catalog(const string &items_list)
+{
+    auto entries = split(items_list, '|');
+    vector<int64_t> starts;
+    int64_t now = time(nullptr);
+    for (size_t i = 1; i < entries.size(); i++)
+    {
+        ItemFields item;
+        if (!parse_item(entries[i], item) || item.inventory <= 0)
+            continue;
+        if (item.listing_type == "auction" && (item.end_time == 0 || item.end_time > now))
+        {
+            catalog.auction_index[item.id] = catalog.auctions.size();
+            catalog.auctions.push_back(item.id);
+            starts.push_back(static_cast<int64_t>(item.current_bid) + 1);
+        }
+        else if (item.listing_type == "fixed")
+        {
+            catalog.fixed.push_back(item.id);
+        }
+    }
+    catalog.next_bid = make_unique<atomic<int64_t>[]>(starts.size());
+    for (size_t i = 0; i < starts.size(); i++)
+        catalog.next_bid[i] = starts[i];
+}
+
+// --------------------------
+// Client Connection
+// --------------------------
+class Client
+{
+    struct Outstanding
+    {
+        Kind kind;
+        chrono::steady_clock::time_point sent;
+        pair<int, int64_t> bid{};  // BID: (item_id, amount)
+        bool answered = false;     // CHECKOUT: ORDER_CREATED seen, ORDERS_LIST still to come
+    };
+
+    ix::WebSocket ws;
+    const Options &options;
+    pair<string, string> user;
+    mt19937_64 rng;
+    vector<pair<Kind, size_t>> weights;
+    size_t weight_total = 0;
+
+    // Only touched from the socket's own callback thread
+    string token;
+    chrono::steady_clock::time_point login_sent;
+    bool in_flight = false;
+    Outstanding current;
+    map<pair<int, int64_t>, chrono::steady_clock::time_point> bids_awaiting_broadcast;
+    WireFrame frame;  // Reused to decode binary frames
+
+    Kind pick()
+    {
+        size_t roll = uniform_int_distribution<size_t>(0, weight_total - 1)(rng);
+        for (const auto &[kind, weight] : weights)
+        {
+            if (roll < weight)
+                return kind;
+            roll -= weight;
+        }
+        return weights.back().first;
+    }
+
+    template <typename T>
+    T choose(const vector<T> &from)
+    {
+        return from[uniform_int_distribution<size_t>(0, from.size() - 1)(rng)];
+    }
+
+    void send_next()
+    {
+        if (!running)
+            return;
+        if (options.think_ms)
+            this_thread::sleep_for(chrono::milliseconds(options.think_ms));
+
+        Kind kind = pick();
+        pair<int, int64_t> bid{};
+        string request;
+        switch (kind)
+        {
+        case Kind::Bid:
+            if (!catalog.auctions.empty())
+            {
+                int item_id = choose(catalog.auctions);
+                int64_t amount = catalog.next_bid[catalog.auction_index[item_id]].fetch_add(1);
+                request = "BID|" + to_string(item_id) + "|" + to_string(amount) + "|" + token;
+                bid = {item_id, amount};
+                break;
+            }
+            kind = Kind::Items;
+            request = "GET_ITEMS";
+            break;
+        case Kind::Cart:
+            if (!catalog.fixed.empty())
+            {
+                request = "ADD_TO_CART|" + to_string(choose(catalog.fixed)) + "|1|" + token;
+                break;
+            }
+            kind = Kind::Items;
+            request = "GET_ITEMS";
+            break;
+        case Kind::Checkout:
+            request = "CHECKOUT|" + token;
+            break;
+        case Kind::Orders:
+            request = "GET_ORDERS|" + token;
+            break;
+        default:
+            kind = Kind::Items;
+            request = "GET_ITEMS";
+            break;
+        }
+
+        current = {kind, chrono::steady_clock::now(), bid};
+        if (kind == Kind::Bid)
+            bids_awaiting_broadcast[bid] = current.sent;
+        in_flight = true;
+        ws.send(request);
+    }
+
+    // Does this reply finish the outstanding request?
+    bool completes(const string &reply)
+    {
+        bool error = reply.compare(0, 6, "ERROR|") == 0;
+        switch (current.kind)
+        {
+        case Kind::Bid:
+            return error || reply.compare(0, 4, "ACK|") == 0;
+        case Kind::Cart:
+            return error || reply.compare(0, 13, "CART_UPDATED|") == 0;
+        case Kind::Checkout:
+            // A successful checkout is followed by CART_ITEMS and ORDERS_LIST;
+            // wait for the last so it isn't mistaken for the next GET_ORDERS
+            if (current.answered)
+                return reply.compare(0, 11, "ORDERS_LIST") == 0;
+            return error || reply.compare(0, 14, "ORDER_CREATED|") == 0;
+        case Kind::Items:
+            return reply.compare(0, 10, "ITEMS_LIST") == 0;
+        case Kind::Orders:
+            return error || reply.compare(0, 11, "ORDERS_LIST") == 0;
+        default:
+            return false;
+        }
+    }
+
+    void on_item_update(int item_id, double current_bid)
+    {
+        auto it = bids_awaiting_broadcast.find({item_id, static_cast<int64_t>(llround(current_bid))});
+        if (it != bids_awaiting_broadcast.end())
+        {
+            stats.bid_broadcast.record(chrono::steady_clock::now() - it->second);
+            bids_awaiting_broadcast.erase(it);
+        }
+    }
+
+    void on_item_update(const string &reply)
+    {
+        // ITEM_UPDATE|<catalog version>|<entry>
+        ItemFields item;
+        size_t entry = reply.find('|', 12);
+        if (bids_awaiting_broadcast.empty() || entry == string::npos || !parse_item(reply.substr(entry + 1), item))
+            return;
+        on_item_update(item.id, item.current_bid);
+    }
+
+    // Decodes a binary frame, then handles it like its text counterpart
+    void on_binary(const string &reply)
+    {
+        static const char *const names[] = {nullptr, nullptr, "ITEMS_LIST", "ITEMS_SNAPSHOT",
+                                            "ITEMS_DELTA", "CART_ITEMS", "ORDERS_LIST"};
+        if (!decode_frame(reply, frame))
+        {
+            stats.malformed++;
+            return;
+        }
+        if (frame.type == WireType::ItemUpdate)
+            on_item_update(frame.items[0].id, frame.items[0].current_bid);
+        else
+            on_message(names[static_cast<size_t>(frame.type)]);
+    }
+
+    void on_message(const string &reply)
+    {
+        if (reply.compare(0, 12, "ITEM_UPDATE|") == 0)
+        {
+            on_item_update(reply);
+            return;
+        }
+
+        if (token.empty())
+        {
+            if (reply.compare(0, 14, "LOGIN_SUCCESS|") == 0)
+            {
+                stats.login.record(chrono::steady_clock::now() - login_sent);
+                stats.logged_in++;
+                token = split(reply, '|')[1];
+                send_next();
+            }
+            else if (reply.compare(0, 6, "ERROR|") == 0)
+            {
+                fprintf(stderr, "login failed for %s: %s\n", user.first.c_str(), reply.c_str());
+                stats.failed++;
+            }
+            return;
+        }
+
+        if (!in_flight || !completes(reply))
+            return;
+
+        size_t kind = static_cast<size_t>(current.kind);
+        bool error = reply.compare(0, 6, "ERROR|") == 0;
+        if (!current.answered)
+        {
+            stats.request[kind].record(chrono::steady_clock::now() - current.sent);
+            if (error)
+                stats.errors[kind]++;
+        }
+
+        if (current.kind == Kind::Bid && error)
+        {
+            // Rejected or outbid in the same burst; no broadcast will carry it
+            bids_awaiting_broadcast.erase(current.bid);
+        }
+        else if (current.kind == Kind::Checkout && !error && !current.answered)
+        {
+            current.answered = true;
+            return;
+        }
+
+        // Broadcasts lost to a slow socket would otherwise pile up here
+        if (bids_awaiting_broadcast.size() > 64)
+            bids_awaiting_broadcast.erase(bids_awaiting_broadcast.begin());
+
+        in_flight = false;
+        send_next();
+    }
+
+public:
+    Client(const Options &options, pair<string, string> user, uint64_t seed)
+        : options(options), user(move(user)), rng(seed)
+    {
+        for (const auto &[name, weight] : options.mix)
+        {
+            for (size_t k = 0; k < static_cast<size_t>(Kind::Count); k++)
+            {
+                if (name == kind_names[k] && weight > 0)
+                {
+                    weights.emplace_back(static_cast<Kind>(k), weight);
+                    weight_total += weight;
+                }
+            }
+        }
+        if (weights.empty())
+        {
+            weights.emplace_back(Kind::Items, 1);
+            weight_total = 1;
+        }
+
+        ws.setUrl(options.url);
+        ws.disableAutomaticReconnection();
+        ws.setOnMessageCallback([this](const ix::WebSocketMessagePtr &msg) {
+            if (msg->type == ix::WebSocketMessageType::Open)
+            {
+                if (this->options.binary)
+                    ws.send("PROTOCOL|binary");
+                login_sent = chrono::steady_clock::now();
+                ws.send("LOGIN|" + this->user.first + "|" + this->user.second);
+            }
+            else if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                if (msg->binary)
+                    on_binary(msg->str);
+                else
+                    on_message(msg->str);
+            }
+            else if (msg->type == ix::WebSocketMessageType::Error ||
+                     (msg->type == ix::WebSocketMessageType::Close && running))
+            {
+                stats.failed++;
+            }
+        });
+    }
+
+    void start() { ws.start(); }
+    void stop() { ws.stop(); }
+};
+
+// --------------------------
+// Setup & Report
+// --------------------------
+
+// One throwaway connection reads the catalog so bids and cart adds target
+// items that exist
+bool fetch_catalog(const string &url)
+{
+    ix::WebSocket probe;
+    mutex mtx;
+    string items_list;
+    bool done = false;
+
+    probe.setUrl(url);
+    probe.disableAutomaticReconnection();
+    probe.setOnMessageCallback([&](const ix::WebSocketMessagePtr &msg) {
+        if (msg->type == ix::WebSocketMessageType::Open)
+        {
+            probe.send("GET_ITEMS");
+        }
+        else if (msg->type == ix::WebSocketMessageType::Message && msg->str.compare(0, 10, "ITEMS_LIST") == 0)
+        {
+            lock_guard<mutex> lock(mtx);
+            items_list = msg->str;
+            done = true;
+        }
+        else if (msg->type == ix::WebSocketMessageType::Error)
+        {
+            fprintf(stderr, "cannot connect to %s: %s\n", url.c_str(), msg->errorInfo.reason.c_str());
+            lock_guard<mutex> lock(mtx);
+            done = true;
+        }
+    });
+    probe.start();
+
+    for (int waited = 0; waited < 100; waited++)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            if (done)
+                break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    probe.stop();
+
+    lock_guard<mutex> lock(mtx);
+    if (items_list.empty())
+        return false;
+    load_catalog(items_list);
+    return true;
+}
+
+uint64_t completed_requests()
+{
+    uint64_t completed = 0;
+    for (const auto &histogram : stats.request)
+        completed += histogram.snapshot().count;
+    return completed;
+}
+
+void print_row(const char *name, const LogHistogram::Snapshot &snap, uint64_t errors, double seconds)
+{
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    printf("%-18s %10llu %8llu %10.1f %9.3f %9.3f %9.3f %9.3f\n", name, static_cast<unsigned long long>(snap.count),
+           static_cast<unsigned long long>(errors), snap.count / seconds, ms(snap.percentile(0.5)),
+           ms(snap.percentile(0.99)), ms(snap.percentile(0.999)), ms(snap.max));
+}
+
+void report(double seconds, size_t connections)
+{
+    uint64_t completed = completed_requests();
+
+    printf("\n%.1fs, %llu/%zu connections logged in, %llu failed, %llu requests (%.0f/s)\n\n", seconds,
+           static_cast<unsigned long long>(stats.logged_in.load()), connections,
+           static_cast<unsigned long long>(stats.failed.load()), static_cast<unsigned long long>(completed),
+           completed / seconds);
+    printf("%-18s %10s %8s %10s %9s %9s %9s %9s\n", "request", "count", "errors", "per_s", "p50_ms", "p99_ms",
+           "p999_ms", "max_ms");
+    for (size_t k = 0; k < stats.request.size(); k++)
+    {
+        auto snap = stats.request[k].snapshot();
+        if (snap.count)
+            print_row(kind_names[k], snap, stats.errors[k], seconds);
+    }
+    print_row("bid->ITEM_UPDATE", stats.bid_broadcast.snapshot(), 0, seconds);
+    print_row("login", stats.login.snapshot(), 0, seconds);
+    if (stats.malformed)
+        printf("\n%llu binary frames failed to decode\n", static_cast<unsigned long long>(stats.malformed.load()));
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+
+    ix::initNetSystem();
+    if (!fetch_catalog(options.url))
+    {
+        fprintf(stderr, "no ITEMS_LIST from %s\n", options.url.c_str());
+        return 1;
+    }
+    fprintf(stderr, "%zu auctions, %zu fixed-price items; opening %zu connections\n", catalog.auctions.size(),
+            catalog.fixed.size(), options.connections);
+
+    vector<unique_ptr<Client>> clients;
+    random_device seeds;
+    for (size_t i = 0; i < options.connections; i++)
+    {
+        clients.push_back(make_unique<Client>(options, options.users[i % options.users.size()],
+                                              (static_cast<uint64_t>(seeds()) << 32) ^ i));
+    }
+
+    // Ramp up, then measure the whole run including the ramp
+    auto started = chrono::steady_clock::now();
+    auto deadline = started + chrono::seconds(options.duration_s);
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        clients[i]->start();
+        if ((i + 1) % options.ramp_per_s == 0)
+            this_thread::sleep_until(started + chrono::seconds((i + 1) / options.ramp_per_s));
+    }
+
+    uint64_t last = 0;
+    while (chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::seconds(1));
+        uint64_t completed = completed_requests();
+        fprintf(stderr, "%llu logged in, %llu req/s\n", static_cast<unsigned long long>(stats.logged_in.load()),
+                static_cast<unsigned long long>(completed - last));
+        last = completed;
+    }
+
+    running = false;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    report(seconds, clients.size());
+    fflush(stdout);
+
+    for (auto &client : clients)
+        client->stop();
+    ix::uninitNetSystem();
+    return stats.malformed ? 1 : 0;
+}
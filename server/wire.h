@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// The binary wire format, shared by the server's encoders and anything that
+// reads its frames back (ivory_loadgen, ivory_bench), so both sides are
+// built from one definition.
+//
+// Opt-in alternative to the '|'-delimited text frames, switched on per
+// connection with PROTOCOL|binary. Only the bulky frames below go binary;
+// acks, errors and the rest stay text, so clients tell them apart by the
+// WebSocket opcode. A binary frame is a one-byte type followed by
+// little-endian fields: integers at their fixed width, doubles as raw IEEE 754
+// bits, strings as a u16 byte length and the bytes.
+//
+//   item:      i32 id, u8 auction, f64 current_bid, f64 fixed_price,
+//              i32 inventory, i32 bidder_id, i64 end_time, str name
+//   cart line: i32 item_id, i32 quantity, f64 price, str name
+//   order:     i32 id, f64 total, str status, u16 count, count x
+//              (i32 item_id, i32 quantity, f64 price)
+enum class WireType : uint8_t
+{
+    ItemUpdate = 0x01,     // u64 version, item
+    ItemsList = 0x02,      // u32 count, items
+    ItemsSnapshot = 0x03,  // u64 version, u32 count, items
+    ItemsDelta = 0x04,     // u64 version, u32 count, items
+    CartItems = 0x05,      // u32 count, cart lines, f64 total
+    OrdersList = 0x06,     // u32 count, orders, i32 next cursor (0 = none)
+    Bid = 0x10,            // from clients: i32 item_id, f64 amount, session token (rest of frame)
+};
+
+// --------------------------
+// Fields
+// --------------------------
+template <typename T>
+void put_le(std::string &out, T value)
+{
+    static_assert(std::is_arithmetic_v<T>, "only numbers have a fixed width");
+    uint64_t bits;
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        static_assert(sizeof(T) == sizeof(uint64_t), "doubles only");
+        std::memcpy(&bits, &value, sizeof(bits));
+    }
+    else
+    {
+        bits = static_cast<std::make_unsigned_t<T>>(value);
+    }
+    for (size_t i = 0; i < sizeof(T); i++)
+        out.push_back(static_cast<char>(bits >> (8 * i)));
+}
+
+// Reads one field off the front of in; false if the frame is too short
+template <typename T>
+bool get_le(std::string_view &in, T &value)
+{
+    static_assert(std::is_arithmetic_v<T>, "only numbers have a fixed width");
+    if (in.size() < sizeof(T))
+        return false;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        bits |= uint64_t(static_cast<uint8_t>(in[i])) << (8 * i);
+    if constexpr (std::is_floating_point_v<T>)
+        std::memcpy(&value, &bits, sizeof(value));
+    else
+        value = static_cast<T>(static_cast<std::make_unsigned_t<T>>(bits));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+inline void put_str(std::string &out, std::string_view value)
+{
+    value = value.substr(0, UINT16_MAX);
+    put_le(out, static_cast<uint16_t>(value.size()));
+    out.append(value);
+}
+
+inline bool get_str(std::string_view &in, std::string &value)
+{
+    uint16_t size;
+    if (!get_le(in, size) || in.size() < size)
+        return false;
+    value.assign(in.substr(0, size));
+    in.remove_prefix(size);
+    return true;
+}
+
+inline std::string wire_header(WireType type)
+{
+    return std::string(1, static_cast<char>(type));
+}
+
+// --------------------------
+// Decoding
+// --------------------------
+struct WireItem
+{
+    int32_t id = 0;
+    bool auction = false;
+    double current_bid = 0.0;
+    double fixed_price = 0.0;
+    int32_t inventory = 0;
+    int32_t bidder_id = 0;
+    int64_t end_time = 0;
+    std::string name;
+};
+
+struct WireCartLine
+{
+    int32_t item_id = 0;
+    int32_t quantity = 0;
+    double price = 0.0;
+    std::string name;
+};
+
+struct WireOrderLine
+{
+    int32_t item_id = 0;
+    int32_t quantity = 0;
+    double price = 0.0;
+};
+
+struct WireOrder
+{
+    int32_t id = 0;
+    double total = 0.0;
+    std::string status;
+    std::vector<WireOrderLine> lines;
+};
+
+// One server-to-client frame. Only the members its type carries are set.
+struct WireFrame
+{
+    WireType type{};
+    uint64_t version = 0;           // ItemUpdate, ItemsSnapshot, ItemsDelta
+    std::vector<WireItem> items;    // One for ItemUpdate
+    std::vector<WireCartLine> cart;
+    double cart_total = 0.0;
+    std::vector<WireOrder> orders;
+    int32_t next_cursor = 0;
+};
+
+inline bool decode_item(std::string_view &in, WireItem &item)
+{
+    uint8_t auction;
+    if (!get_le(in, item.id) || !get_le(in, auction) || auction > 1 || !get_le(in, item.current_bid) ||
+        !get_le(in, item.fixed_price) || !get_le(in, item.inventory) || !get_le(in, item.bidder_id) ||
+        !get_le(in, item.end_time) || !get_str(in, item.name))
+    {
+        return false;
+    }
+    item.auction = auction;
+    return true;
+}
+
+// Reads a u32 count and that many records. The count is checked against the
+// bytes left, so a corrupt frame can't make it reserve gigabytes.
+template <typename T, typename Decode>
+bool decode_list(std::string_view &in, std::vector<T> &out, size_t min_size, Decode decode)
+{
+    uint32_t count;
+    if (!get_le(in, count) || count > in.size() / min_size)
+        return false;
+    out.resize(count);
+    for (T &record : out)
+    {
+        if (!decode(in, record))
+            return false;
+    }
+    return true;
+}
+
+// False unless data is a well-formed server frame with nothing left over
+inline bool decode_frame(std::string_view data, WireFrame &frame)
+{
+    constexpr size_t item_size = 4 + 1 + 8 + 8 + 4 + 4 + 8 + 2;
+    constexpr size_t cart_line_size = 4 + 4 + 8 + 2;
+    constexpr size_t order_size = 4 + 8 + 2 + 2;
+
+    uint8_t type;
+    if (!get_le(data, type))
+        return false;
+    frame = WireFrame{};
+    frame.type = static_cast<WireType>(type);
+
+    bool ok = false;
+    switch (frame.type)
+    {
+    case WireType::ItemUpdate:
+        frame.items.resize(1);
+        ok = get_le(data, frame.version) && decode_item(data, frame.items[0]);
+        break;
+    case WireType::ItemsSnapshot:
+    case WireType::ItemsDelta:
+        if (!get_le(data, frame.version))
+            return false;
+        [[fallthrough]];
+    case WireType::ItemsList:
+        ok = decode_list(data, frame.items, item_size, decode_item);
+        break;
+    case WireType::CartItems:
+        ok = decode_list(data, frame.cart, cart_line_size,
+                         [](std::string_view &in, WireCartLine &line) {
+                             return get_le(in, line.item_id) && get_le(in, line.quantity) &&
+                                    get_le(in, line.price) && get_str(in, line.name);
+                         }) &&
+             get_le(data, frame.cart_total);
+        break;
+    case WireType::OrdersList:
+        ok = decode_list(data, frame.orders, order_size,
+                         [](std::string_view &in, WireOrder &order) {
+                             uint16_t count;
+                             if (!get_le(in, order.id) || !get_le(in, order.total) || !get_str(in, order.status) ||
+                                 !get_le(in, count) || count > in.size() / (4 + 4 + 8))
+                             {
+                                 return false;
+                             }
+                             order.lines.resize(count);
+                             for (WireOrderLine &line : order.lines)
+                             {
+                                 if (!get_le(in, line.item_id) || !get_le(in, line.quantity) || !get_le(in, line.price))
+                                     return false;
+                             }
+                             return true;
+                         }) &&
+             get_le(data, frame.next_cursor);
+        break;
+    default:
+        return false;
+    }
+    return ok && data.empty();
+}